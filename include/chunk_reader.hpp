@@ -0,0 +1,194 @@
+#ifndef CPPLISPREADER_CHUNK_READER_HPP
+#define CPPLISPREADER_CHUNK_READER_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace lisp_reader {
+  // Front end for readers whose input arrives a chunk at a time (files read in blocks, decompressors)
+  // Source provides the chunks, with:
+  //   void acquire(const char *&data, std::size_t &len)	Waits for the next chunk in order, len is 0 at the end
+  //   void release()						Hands the last acquired chunk back to be refilled
+  // The per character path only touches the current chunk, the Source is only involved once per chunk
+  template <typename Source>
+  class ChunkReader {
+  public:
+    template <typename... Args>
+    explicit ChunkReader(Args &&...args)
+      : _src(std::make_unique<Source>(std::forward<Args>(args)...)), _cur(nullptr), _pos(0), _len(0), _base(0) {}
+
+    bool read(char &c) {
+      if(_pos == _len && !_next()) return false;
+
+      c = _cur[_pos++];
+      return true;
+    }
+    bool peek(char &c) const {
+      if(_pos == _len && !_next()) return false;
+
+      c = _cur[_pos];
+      return true;
+    }
+    bool canRead() const {return _pos < _len || _next();}
+    // Number of characters read so far
+    std::size_t offset() const {return _base + _pos;}
+  private:
+    // Behind a pointer so the reader stays movable, whatever the Source holds (threads, locks, file handles)
+    std::unique_ptr<Source> _src;
+    // The chunk being read, peek() may have to move on to the next one, hence mutable
+    mutable const char *_cur;
+    mutable std::size_t _pos;
+    mutable std::size_t _len;
+    // Offset of the start of the current chunk
+    mutable std::size_t _base;
+
+    // Moves on to the next chunk, returns false at the end of the input
+    bool _next() const {
+      if(_cur) {
+	_src->release();
+	_base += _len;
+      }
+
+      _src->acquire(_cur, _len);
+      _pos = 0;
+      // Leave the last, empty chunk acquired, so every further call ends up here again
+      if(!_len) {
+	_cur = nullptr;
+	return false;
+      }
+
+      return true;
+    }
+  };
+
+  // A Source that fills a ring of buffers from a Producer, providing:
+  //   std::size_t fill(char *buf, std::size_t cap)	Writes up to cap characters, returns 0 at the end, may throw
+  // When threaded, a helper thread keeps the ring filled ahead of the reader, so producing the next chunk overlaps
+  // with tokenizing the current one. Otherwise chunks are produced on the reader's thread as they are needed
+  template <typename Producer>
+  class ProducerSource {
+  public:
+    ProducerSource(Producer &&producer, std::size_t chunkSize, bool threaded = true, std::size_t depth = 2)
+      : _producer(std::move(producer)), _slots(threaded ? std::max<std::size_t>(depth, 2) : 1), _readSlot(0),
+	_chunkSize(std::max<std::size_t>(chunkSize, 1)), _threaded(threaded), _stop(false) {
+      for(Slot &s : _slots) s.data.resize(_chunkSize);
+      if(_threaded)
+	_thread = std::thread([this]() {_fill();});
+    }
+    ProducerSource(const ProducerSource &) = delete;
+    ProducerSource &operator=(const ProducerSource &) = delete;
+    ~ProducerSource() {
+      if(!_threaded) return;
+
+      {
+	std::lock_guard<std::mutex> lock(_m);
+	_stop = true;
+      }
+      _cv.notify_all();
+      _thread.join();
+    }
+
+    void acquire(const char *&data, std::size_t &len) {
+      Slot &s = _slots[_readSlot];
+      if(_threaded) {
+	std::unique_lock<std::mutex> lock(_m);
+	_cv.wait(lock, [&s]() {return s.ready;});
+      }
+      else if(!s.ready) {
+	s.len = _produce(s.data.data(), s.err);
+	s.ready = true;
+      }
+
+      if(s.err)
+	std::rethrow_exception(s.err);
+
+      data = s.data.data();
+      len = s.len;
+    }
+
+    void release() {
+      Slot &s = _slots[_readSlot];
+      {
+	std::unique_lock<std::mutex> lock(_m, std::defer_lock);
+	if(_threaded) lock.lock();
+	s.ready = false;
+	s.len = 0;
+      }
+      if(_threaded) _cv.notify_all();
+      _readSlot = (_readSlot + 1) % _slots.size();
+    }
+  private:
+    struct Slot {
+      std::vector<char> data;
+      std::size_t len = 0;
+      bool ready = false;
+      // Set when the producer threw, rethrown on the reader's thread
+      std::exception_ptr err;
+    };
+
+    Producer _producer;
+    std::vector<Slot> _slots;
+    std::size_t _readSlot;
+    std::size_t _chunkSize;
+    bool _threaded;
+    // Set once the producer is exhausted or failed, it is not called again after that
+    bool _done = false;
+
+    // Only used when threaded
+    std::thread _thread;
+    std::mutex _m;
+    std::condition_variable _cv;
+    bool _stop;
+
+    // Fills a buffer as far as the producer allows, returning its length
+    // Short fills are topped up so chunks stay large
+    std::size_t _produce(char *buf, std::exception_ptr &err) {
+      std::size_t len = 0;
+      try {
+	while(!_done && len < _chunkSize) {
+	  std::size_t n = _producer.fill(buf + len, _chunkSize - len);
+	  if(!n) _done = true;
+	  len += n;
+	}
+      }
+      catch(...) {
+	err = std::current_exception();
+	_done = true;
+      }
+
+      return len;
+    }
+
+    // Runs on the helper thread, filling each slot in turn as soon as the reader gives it back
+    // Once the producer is exhausted every remaining slot is marked ready and empty
+    void _fill() {
+      for(std::size_t i = 0;; i = (i + 1) % _slots.size()) {
+	Slot &s = _slots[i];
+	{
+	  std::unique_lock<std::mutex> lock(_m);
+	  _cv.wait(lock, [this, &s]() {return _stop || !s.ready;});
+	  if(_stop) return;
+	}
+
+	// The buffer is ours until the slot is marked ready, produce without holding the lock
+	std::exception_ptr err;
+	std::size_t len = _produce(s.data.data(), err);
+	{
+	  std::lock_guard<std::mutex> lock(_m);
+	  s.len = len;
+	  s.err = err;
+	  s.ready = true;
+	}
+	_cv.notify_all();
+      }
+    }
+  };
+};				// lisp_reader
+
+#endif // CPPLISPREADER_CHUNK_READER_HPP
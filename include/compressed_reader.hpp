@@ -0,0 +1,166 @@
+#ifndef CPPLISPREADER_COMPRESSED_READER_HPP
+#define CPPLISPREADER_COMPRESSED_READER_HPP
+
+#include "reader.hpp"
+#include "chunk_reader.hpp"
+#include "pipelined_reader.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef LISP_READER_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef LISP_READER_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace lisp_reader {
+  // Size of the buffer compressed input is read into
+  constexpr std::size_t COMPRESSED_INPUT_SIZE = 256 << 10;
+
+#ifdef LISP_READER_HAVE_ZLIB
+  // Produces the decompressed contents of a gzip (or zlib) file, for ProducerSource
+  // Files made of several concatenated gzip members, as written by pigz or bgzip, are read as one
+  class GzipProducer {
+  public:
+    explicit GzipProducer(const std::string &path)
+      : _file(path), _in(COMPRESSED_INPUT_SIZE), _off(0), _strm(std::make_unique<z_stream>()), _end(false) {
+      // 32 on top of the window bits detects a gzip or zlib header automatically
+      if(::inflateInit2(_strm.get(), 15 + 32) != Z_OK)
+	throw std::runtime_error("Cannot initialize zlib for " + path);
+    }
+    GzipProducer(GzipProducer &&) = default;
+    ~GzipProducer() {
+      if(_strm) ::inflateEnd(_strm.get());
+    }
+
+    std::size_t fill(char *buf, std::size_t cap) {
+      _strm->next_out = reinterpret_cast<Bytef *>(buf);
+      _strm->avail_out = static_cast<uInt>(std::min<std::size_t>(cap, std::numeric_limits<uInt>::max()));
+
+      while(_strm->avail_out > 0 && !_end) {
+	if(_strm->avail_in == 0) {
+	  std::size_t n = _file.pread(_in.data(), _in.size(), _off);
+	  _off += n;
+	  if(!n) {
+	    // Running out of input is only fine between members
+	    if(_mid) throw std::runtime_error("Truncated gzip stream");
+	    _end = true;
+	    break;
+	  }
+	  _strm->next_in = reinterpret_cast<Bytef *>(_in.data());
+	  _strm->avail_in = static_cast<uInt>(n);
+	}
+
+	int ret = ::inflate(_strm.get(), Z_NO_FLUSH);
+	_mid = true;
+	if(ret == Z_STREAM_END) {
+	  // Another member may follow
+	  ::inflateReset(_strm.get());
+	  _mid = false;
+	}
+	else if(ret != Z_OK && ret != Z_BUF_ERROR)
+	  throw std::runtime_error(std::string("Corrupt gzip stream: ") + (_strm->msg ? _strm->msg : "unknown error"));
+      }
+
+      return cap - _strm->avail_out;
+    }
+  private:
+    FileHandle _file;
+    std::vector<char> _in;
+    std::size_t _off;
+    // zlib keeps pointers back into the stream, so it cannot move with the producer
+    std::unique_ptr<z_stream> _strm;
+    bool _end;
+    // Inside a member, as opposed to before the first or between two
+    bool _mid = false;
+  };
+
+  // Reads a gzip compressed file, decompressing straight into the tokenizer's chunk buffers
+  // When threaded, decompression runs on a helper thread a chunk ahead of the tokenizer
+  class GzipReader : public ChunkReader<ProducerSource<GzipProducer>> {
+  public:
+    explicit GzipReader(const std::string &path, bool threaded = false, std::size_t chunkSize = 1 << 20)
+      : ChunkReader(GzipProducer(path), chunkSize, threaded) {}
+  };
+
+  // Useful typedefs
+  typedef Tokenizer<GzipReader> GzipTokenizer;
+#endif
+
+#ifdef LISP_READER_HAVE_ZSTD
+  // Produces the decompressed contents of a zstd file, for ProducerSource
+  // Files made of several concatenated frames are read as one
+  class ZstdProducer {
+  public:
+    explicit ZstdProducer(const std::string &path)
+      : _file(path), _in(ZSTD_DStreamInSize()), _input{_in.data(), 0, 0}, _off(0),
+	_strm(ZSTD_createDStream(), &ZSTD_freeDStream), _mid(false) {
+      if(!_strm)
+	throw std::runtime_error("Cannot initialize zstd for " + path);
+    }
+
+    std::size_t fill(char *buf, std::size_t cap) {
+      ZSTD_outBuffer out{buf, cap, 0};
+
+      while(out.pos < out.size) {
+	if(_input.pos == _input.size) {
+	  std::size_t n = _file.pread(_in.data(), _in.size(), _off);
+	  _off += n;
+	  if(!n) {
+	    if(!_mid) break;
+	    // The decoder can still hold output of input it already took, when the last call filled the buffer
+	    // Flush it, the stream is only truncated if that gets nowhere
+	    // What this call did produce is handed out first, the next one reports the truncation
+	    std::size_t before = out.pos;
+	    _decompress(out);
+	    if(_mid && out.pos == before) {
+	      if(out.pos) break;
+	      throw std::runtime_error("Truncated zstd stream");
+	    }
+	    continue;
+	  }
+	  _input = ZSTD_inBuffer{_in.data(), n, 0};
+	}
+
+	_decompress(out);
+      }
+
+      return out.pos;
+    }
+  private:
+    void _decompress(ZSTD_outBuffer &out) {
+      std::size_t ret = ZSTD_decompressStream(_strm.get(), &out, &_input);
+      if(ZSTD_isError(ret))
+	throw std::runtime_error(std::string("Corrupt zstd stream: ") + ZSTD_getErrorName(ret));
+      // 0 means a frame was completely decoded and flushed
+      _mid = ret != 0;
+    }
+
+    FileHandle _file;
+    std::vector<char> _in;
+    ZSTD_inBuffer _input;
+    std::size_t _off;
+    std::unique_ptr<ZSTD_DStream, std::size_t (*)(ZSTD_DStream *)> _strm;
+    bool _mid;
+  };
+
+  // Reads a zstd compressed file, decompressing straight into the tokenizer's chunk buffers
+  // When threaded, decompression runs on a helper thread a chunk ahead of the tokenizer
+  class ZstdReader : public ChunkReader<ProducerSource<ZstdProducer>> {
+  public:
+    explicit ZstdReader(const std::string &path, bool threaded = false, std::size_t chunkSize = 1 << 20)
+      : ChunkReader(ZstdProducer(path), chunkSize, threaded) {}
+  };
+
+  // Useful typedefs
+  typedef Tokenizer<ZstdReader> ZstdTokenizer;
+#endif
+};				// lisp_reader
+
+#endif // CPPLISPREADER_COMPRESSED_READER_HPP
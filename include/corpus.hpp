@@ -0,0 +1,203 @@
+#ifndef CPPLISPREADER_CORPUS_HPP
+#define CPPLISPREADER_CORPUS_HPP
+
+#include "reader.hpp"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace lisp_reader {
+  // Shape of a generated corpus, see CorpusGenerator
+  struct CorpusOptions {
+    std::uint64_t seed = 1;
+    // Nesting: lists never go deeper than maxDepth, and each element of a list is itself a list with
+    // nestProbability, which halves with every level so deep forms stay rare
+    std::size_t maxDepth = 8;
+    double nestProbability = 0.3;
+    std::size_t maxListLength = 8;
+    // Relative weights of the atoms, indexed by TokenType, parenthesis are ignored
+    // COMMENT sets the comment density, a comment always runs to the end of its line
+    std::array<double, static_cast<int>(TokenType::END)> mix{0, 0, 30, 3, 20, 5, 5, 3, 10};
+    // Lengths are drawn uniformly up to these
+    std::size_t maxSymbolLength = 16;
+    std::size_t maxStringLength = 48;
+    std::size_t maxCommentLength = 60;
+    // Fraction of symbols holding a backslash or pipe escape
+    double escapeRate = 0.02;
+  };
+
+  // Generates synthetic Lisp with a controllable mix of every kind of token the Tokenizer accepts
+  // Output only depends on the options: the random generator (splitmix64) and every distribution are
+  // implemented here rather than taken from <random>, whose distributions differ between standard libraries
+  // Forms are produced one at a time, so corpora of any size stream out in constant memory
+  class CorpusGenerator {
+  public:
+    explicit CorpusGenerator(const CorpusOptions &opts = {}) : _opts(opts), _state(opts.seed) {
+      double total = 0;
+      for(std::size_t i = 0; i < _cumulative.size(); ++i) {
+	bool atom = i != static_cast<std::size_t>(TokenType::OPEN_PARENTHESIS) &&
+	  i != static_cast<std::size_t>(TokenType::CLOSE_PARENTHESIS);
+	total += atom && opts.mix[i] > 0 ? opts.mix[i] : 0;
+	_cumulative[i] = total;
+      }
+      if(total <= 0)
+	throw std::invalid_argument("The atom mix needs at least one positive weight");
+    }
+
+    // Appends the next top-level form, followed by a newline
+    // Most are lists, like in source files, some are bare atoms
+    void form(std::string &out) {
+      if(_opts.maxDepth > 0 && _chance(0.9)) _list(out, 1);
+      else _atom(out);
+      out += '\n';
+    }
+
+    // Appends forms until out has grown by at least size characters
+    void generate(std::string &out, std::size_t size) {
+      std::size_t target = out.size() + size;
+      while(out.size() < target) form(out);
+    }
+  private:
+    static constexpr std::string_view SYMBOL_START = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ*<>=!?_%&";
+    static constexpr std::string_view SYMBOL_CHARS = "abcdefghijklmnopqrstuvwxyz0123456789-+*/<>=!?_.%&";
+    static constexpr std::string_view ESCAPABLE = "()\"'`,:;\\| ";
+    // Anything but a double quote, including newlines, parenthesis and semicolons
+    static constexpr std::string_view STRING_CHARS = "abcdefghijklmnopqrstuvwxyz     ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789()';\n\\|.,";
+    static constexpr std::string_view COMMENT_CHARS = "abcdefghijklmnopqrstuvwxyz     0123456789()\";.,";
+
+    CorpusOptions _opts;
+    std::uint64_t _state;
+    std::array<double, static_cast<int>(TokenType::END)> _cumulative;
+
+    // splitmix64
+    std::uint64_t _next() {
+      std::uint64_t z = (_state += 0x9e3779b97f4a7c15ull);
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+      return z ^ (z >> 31);
+    }
+    // Uniform in [0, n), the modulo bias is irrelevant at these ranges
+    std::uint64_t _below(std::uint64_t n) {return n ? _next() % n : 0;}
+    // Uniform in [0, 1)
+    double _uniform() {return static_cast<double>(_next() >> 11) * (1.0 / (1ull << 53));}
+    bool _chance(double p) {return _uniform() < p;}
+    char _pick(std::string_view chars) {return chars[_below(chars.size())];}
+
+    void _digits(std::string &out, std::size_t max) {
+      for(std::size_t n = 1 + _below(max); n > 0; --n) out += static_cast<char>('0' + _below(10));
+    }
+    void _sign(std::string &out) {
+      switch(_below(4)) {
+      case 0: out += '-'; break;
+      case 1: out += '+'; break;
+      default: break;
+      }
+    }
+
+    void _list(std::string &out, std::size_t depth) {
+      out += '(';
+      std::size_t len = _below(_opts.maxListLength + 1);
+      // Halves with every level
+      double nest = _opts.nestProbability / static_cast<double>(1ull << std::min<std::size_t>(depth - 1, 62));
+      for(std::size_t i = 0; i < len; ++i) {
+	if(i) out += _chance(0.1) ? '\n' : ' ';
+	if(depth < _opts.maxDepth && _chance(nest)) _list(out, depth + 1);
+	else _atom(out);
+      }
+      out += ')';
+    }
+
+    void _atom(std::string &out) {
+      double r = _uniform() * _cumulative.back();
+      std::size_t type = 0;
+      while(_cumulative[type] <= r) ++type;
+
+      switch(static_cast<TokenType>(type)) {
+      case TokenType::INT:
+	_sign(out);
+	_digits(out, 9);
+	break;
+      case TokenType::FLOAT:
+	_sign(out);
+	switch(_below(3)) {
+	case 0:			// 1.5
+	  _digits(out, 6);
+	  out += '.';
+	  _digits(out, 6);
+	  break;
+	case 1:			// .5
+	  out += '.';
+	  _digits(out, 6);
+	  break;
+	default:		// 1.5e-3, kept well within the range of a float
+	  _digits(out, 3);
+	  out += '.';
+	  _digits(out, 3);
+	  out += 'e';
+	  _sign(out);
+	  _digits(out, 1);
+	  break;
+	}
+	break;
+      case TokenType::DOUBLE:
+	_sign(out);
+	_digits(out, 6);
+	if(_chance(0.5)) {
+	  out += '.';
+	  _digits(out, 6);
+	}
+	out += 'd';
+	_sign(out);
+	_digits(out, 2);
+	break;
+      case TokenType::FRACTION:
+	_sign(out);
+	_digits(out, 4);
+	out += '/';
+	out += static_cast<char>('1' + _below(9));
+	_digits(out, 3);
+	break;
+      case TokenType::STRING:
+	out += '"';
+	for(std::size_t n = _below(_opts.maxStringLength + 1); n > 0; --n) out += _pick(STRING_CHARS);
+	out += '"';
+	break;
+      case TokenType::COMMENT:
+	for(std::size_t n = 1 + _below(3); n > 0; --n) out += ';';
+	if(_chance(0.8)) out += ' ';
+	for(std::size_t n = _below(_opts.maxCommentLength + 1); n > 0; --n) out += _pick(COMMENT_CHARS);
+	out += '\n';
+	break;
+      default:
+	_symbol(out);
+	break;
+      }
+    }
+
+    void _symbol(std::string &out) {
+      out += _pick(SYMBOL_START);
+      std::size_t len = _below(_opts.maxSymbolLength);
+      bool escape = _chance(_opts.escapeRate);
+      std::size_t at = _below(len + 1);
+      for(std::size_t i = 0; i <= len; ++i) {
+	if(escape && i == at) {
+	  if(_chance(0.5)) {
+	    out += '\\';
+	    out += _pick(ESCAPABLE);
+	  }
+	  else {
+	    out += '|';
+	    for(std::size_t n = _below(8); n > 0; --n) out += _pick(ESCAPABLE.substr(0, ESCAPABLE.size() - 3));
+	    out += ' ';
+	    out += '|';
+	  }
+	}
+	if(i < len) out += _pick(SYMBOL_CHARS);
+      }
+    }
+  };
+};				// lisp_reader
+
+#endif // CPPLISPREADER_CORPUS_HPP
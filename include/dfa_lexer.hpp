@@ -0,0 +1,283 @@
+#ifndef CPPLISPREADER_DFA_LEXER_HPP
+#define CPPLISPREADER_DFA_LEXER_HPP
+
+#include "reader.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// Computed goto (labels as values) is a GNU extension, GCC and Clang both have it
+#if defined(__GNUC__) && !defined(LISP_READER_NO_COMPUTED_GOTO)
+#define LISP_READER_COMPUTED_GOTO
+#endif
+
+namespace lisp_reader {
+  // The atom tables come from the generated DFA in reader.hpp, see grammar/atoms.grammar
+  namespace dfa {
+    // How read() starts a token, by its first character
+    enum Lead : std::uint8_t { ATOM, OPEN, CLOSE, STRING, COMMENT };
+    constexpr std::array<Lead, 256> makeLeads() {
+      std::array<Lead, 256> ret{};
+      ret[static_cast<unsigned char>(token_chars::OPEN_PARENTHESIS)] = OPEN;
+      ret[static_cast<unsigned char>(token_chars::CLOSE_PARENTHESIS)] = CLOSE;
+      ret[static_cast<unsigned char>(token_chars::STRING)] = STRING;
+      ret[static_cast<unsigned char>(token_chars::COMMENT)] = COMMENT;
+      return ret;
+    }
+    inline constexpr std::array<Lead, 256> leads = makeLeads();
+  } // dfa
+
+  // Reads the same tokens as Tokenizer, with the same limits and errors, from a contiguous buffer
+  // Atoms run the same generated DFA as Tokenizer, but straight over the buffer, one table lookup and one
+  // indirect jump per character. With computed goto every state has a jump of its own, so the branch
+  // predictor learns each state's likely successors separately. Only escaped symbols take a slower path
+  // Token text stays in the buffer until the token is complete, so it is copied once, and strings and
+  // comments are found with memchr
+  class DfaTokenizer {
+  public:
+    DfaTokenizer(std::string_view input, ReaderLimits limits = {},
+		 std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : _in(input), _limits(limits), _resource(resource), _pos(0), _depth(0), _count(0), _start(0), _end(0) {
+      _skipSpace();
+    }
+
+    bool canRead() const {return _pos < _in.size();}
+    // NOTE: Undefined behavior if read without checking canRead() first
+    Token read();
+
+    std::size_t depth() const {return _depth;}
+    std::size_t count() const {return _count;}
+    std::pair<std::size_t, std::size_t> span() const {return {_start, _end};}
+    std::size_t offset() const {return _pos;}
+
+    // See Tokenizer::checkpoint(), the same checkpoints work for both
+    Checkpoint checkpoint() const {return {_pos, _depth, _count};}
+    void restore(const Checkpoint &cp) {
+      _pos = std::min(cp.offset, _in.size());
+      _depth = cp.depth;
+      _count = cp.count;
+      _start = _end = _pos;
+      _skipSpace();
+    }
+  private:
+    std::string_view _in;
+    ReaderLimits _limits;
+    std::pmr::memory_resource *_resource;
+    std::size_t _pos;
+    std::size_t _depth;
+    std::size_t _count;
+    std::size_t _start;
+    std::size_t _end;
+
+    Token _atom();
+    Token _escapedSymbol(std::size_t begin);
+    Token _string();
+    Token _comment();
+
+    const unsigned char *_at(std::size_t i) const {return reinterpret_cast<const unsigned char *>(_in.data()) + i;}
+
+    void _skipSpace() {
+      while(_pos < _in.size() && dfa::classes[*_at(_pos)] == dfa::SPACE) ++_pos;
+    }
+
+    // Throws if a token of len characters is over its limit, see Tokenizer::_lengthLimit
+    void _checkLength(std::size_t len, Limit limit) const {
+      std::size_t max = _limits.maxTokenLength;
+      if(limit == Limit::STRING_LENGTH && _limits.maxStringLength && (!max || _limits.maxStringLength < max))
+	max = _limits.maxStringLength;
+      else
+	limit = Limit::TOKEN_LENGTH;
+      if(max && len > max)
+	throw LimitError(limit, max, _count);
+    }
+    // For text that ends in another error: Tokenizer only checks the limit when its buffer is full, so it
+    // only gets to throw LimitError first once the text is past the inline capacity
+    void _checkPartial(std::size_t len, Limit limit) const {
+      if(len > SmallString::INLINE_CAPACITY) _checkLength(len, limit);
+    }
+  };
+
+  inline Token DfaTokenizer::read() {
+    if(_limits.maxTokens && _count >= _limits.maxTokens)
+      throw LimitError(Limit::TOKENS, _limits.maxTokens, _count);
+
+    _start = _pos;
+    Token ret;
+    // A dense switch, compiled to a jump table
+    switch(dfa::leads[*_at(_pos)]) {
+    case dfa::OPEN:
+      if(_limits.maxDepth && _depth >= _limits.maxDepth)
+	throw LimitError(Limit::DEPTH, _limits.maxDepth, _count);
+      ++_depth;
+      ++_pos;
+      ret.first = TokenType::OPEN_PARENTHESIS;
+      break;
+    case dfa::CLOSE:
+      if(_depth > 0) --_depth;
+      ++_pos;
+      ret.first = TokenType::CLOSE_PARENTHESIS;
+      break;
+    case dfa::STRING:
+      ret = _string();
+      break;
+    case dfa::COMMENT:
+      ret = _comment();
+      break;
+    default:
+      ret = _atom();
+      break;
+    }
+
+    _end = _pos;
+    _skipSpace();
+    ++_count;
+
+    return ret;
+  }
+
+  inline Token DfaTokenizer::_atom() {
+    const unsigned char *const begin = _at(_pos), *const end = _at(_in.size());
+    const unsigned char *p = begin;
+    std::uint8_t s = dfa::START;
+
+#ifdef LISP_READER_COMPUTED_GOTO
+    // Indexed by dfa::State
+#define LISP_READER_DFA_LABEL(N) &&state_##N,
+    static void *const labels[dfa::STATES] = {
+      LISP_READER_ATOM_DFA_STATES(LISP_READER_DFA_LABEL) &&END_ATOM, &&ESCAPE, &&ILLEGAL
+    };
+#undef LISP_READER_DFA_LABEL
+    // Every state consumes a character and jumps straight to the next state, so each has its own indirect jump
+#define LISP_READER_DFA_STATE(N)					\
+    state_##N:								\
+      s = N;								\
+      if(p == end) goto accept;						\
+      goto *labels[dfa::transitions[N][dfa::classes[*p++]]];
+
+    LISP_READER_ATOM_DFA_STATES(LISP_READER_DFA_STATE)
+#undef LISP_READER_DFA_STATE
+
+  END_ATOM:
+    // The delimiter is not part of the atom
+    --p;
+    goto accept;
+  ESCAPE:
+    return _escapedSymbol(p - 1 - _at(0));
+  ILLEGAL:
+    _pos = p - _at(0);
+    _checkPartial(p - 1 - begin, Limit::TOKEN_LENGTH);
+    throw "Unescaped illegal character in symbol";
+
+  accept:
+#else
+    // The same DFA as a plain loop
+    for(; p != end; ++p) {
+      std::uint8_t next = dfa::transitions[s][dfa::classes[*p]];
+      if(next == dfa::END_ATOM) break;
+      if(next == dfa::ESCAPE) return _escapedSymbol(p - _at(0));
+      if(next == dfa::ILLEGAL) {
+	_pos = p + 1 - _at(0);
+	_checkPartial(p - begin, Limit::TOKEN_LENGTH);
+	throw "Unescaped illegal character in symbol";
+      }
+      s = next;
+    }
+#endif
+
+    std::size_t len = p - begin;
+    _pos += len;
+    _checkLength(len, Limit::TOKEN_LENGTH);
+
+    Token ret{dfa::accepts[s], SmallString(std::string_view(reinterpret_cast<const char *>(begin), len), _resource)};
+    if(ret.first == TokenType::END)
+      throw "Too many dots";
+    if(ret.first != TokenType::SYMBOL)
+      detail::parseNumber(ret.first, *ret.second);
+
+    return ret;
+  }
+
+  // Picks up at the first escape of an atom starting at _pos, the rest of it can only be a symbol
+  inline Token DfaTokenizer::_escapedSymbol(std::size_t at) {
+    Token ret{TokenType::SYMBOL, SmallString()};
+    SmallString &val = getTokenVal<TokenType::SYMBOL>(*ret.second);
+
+    // Grows like Tokenizer::_push, never past the length limit
+    std::size_t max = _limits.maxTokenLength;
+    auto push = [&](char c) {
+		  if(val.size() == val.capacity()) {
+		    std::size_t cap = std::max<std::size_t>(2 * val.capacity(), 16);
+		    if(max) {
+		      if(val.size() >= max)
+			throw LimitError(Limit::TOKEN_LENGTH, max, _count);
+		      cap = std::min(cap, max);
+		    }
+		    val.reserve(cap, _resource);
+		  }
+		  val.push_back(c);
+		};
+
+    for(; _pos < at; ++_pos) push(_in[_pos]);
+    while(_pos < _in.size()) {
+      char c = _in[_pos];
+      // Only the stop actions matter from here on, like in Tokenizer::_statefulRead()
+      std::uint8_t action = dfa::stopAction(c);
+      if(action == dfa::END_ATOM) break;
+      ++_pos;
+
+      if(action == dfa::ESCAPE && dfa::classes[static_cast<unsigned char>(c)] == dfa::BACKSLASH) {
+	if(_pos == _in.size()) throw "Cannot end symbol with unescaped backslash";
+	push(_in[_pos++]);
+      }
+      else if(action == dfa::ESCAPE) {
+	const void *close = std::memchr(_in.data() + _pos, c, _in.size() - _pos);
+	std::size_t stop = close ? static_cast<const char *>(close) - _in.data() : _in.size();
+	for(; _pos < stop; ++_pos) push(_in[_pos]);
+	if(!close) throw "Unclosed pipe character found";
+	++_pos;
+      }
+      else if(action == dfa::ILLEGAL)
+	throw "Unescaped illegal character in symbol";
+      else
+	push(c);
+    }
+    _checkLength(val.size(), Limit::TOKEN_LENGTH);
+
+    return ret;
+  }
+
+  inline Token DfaTokenizer::_string() {
+    std::size_t begin = _pos + 1;
+    const void *close = std::memchr(_in.data() + begin, token_chars::STRING, _in.size() - begin);
+    std::size_t len = (close ? static_cast<const char *>(close) - _in.data() : _in.size()) - begin;
+
+    _pos = begin + len;
+    if(!close) {
+      _checkPartial(len, Limit::STRING_LENGTH);
+      throw "Missing closing double-quotes for string literal";
+    }
+    _checkLength(len, Limit::STRING_LENGTH);
+    ++_pos;
+
+    return {TokenType::STRING, SmallString(_in.substr(begin, len), _resource)};
+  }
+
+  inline Token DfaTokenizer::_comment() {
+    std::size_t begin = _pos;
+    while(begin < _in.size() && _in[begin] == token_chars::COMMENT) ++begin;
+
+    const void *nl = std::memchr(_in.data() + begin, '\n', _in.size() - begin);
+    std::size_t stop = nl ? static_cast<const char *>(nl) - _in.data() : _in.size();
+    _pos = stop + (nl != nullptr);
+    _checkLength(stop - begin, Limit::TOKEN_LENGTH);
+
+    // Left-trimmed, like Tokenizer does
+    while(begin < stop && std::isspace(static_cast<unsigned char>(_in[begin]))) ++begin;
+
+    return {TokenType::COMMENT, SmallString(_in.substr(begin, stop - begin), _resource)};
+  }
+};				// lisp_reader
+
+#endif // CPPLISPREADER_DFA_LEXER_HPP
@@ -0,0 +1,155 @@
+#ifndef CPPLISPREADER_INGEST_HPP
+#define CPPLISPREADER_INGEST_HPP
+
+#include "reader.hpp"
+#include "mmap_reader.hpp"
+#include "split.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#include <sys/stat.h>
+
+namespace lisp_reader {
+  // Options for ingest(), see below
+  struct IngestOptions {
+    std::size_t threads = std::thread::hardware_concurrency();
+    // Files larger than this are split into chunks of about this size, 0 never splits
+    std::size_t chunkSize = 16 << 20;
+    ReaderLimits limits;
+  };
+
+  // A piece of a file handed to the processing function, data being its text
+  // The tokenizer starts at offset with the nesting depth at the start of the chunk, so its spans are offsets into
+  // the file and maxDepth applies to the whole file. It stops at the end of the chunk, and its count() and
+  // maxTokens only cover the chunk
+  struct Chunk {
+    std::size_t file;
+    std::size_t index;
+    std::size_t offset;
+    std::size_t depth;
+    std::string_view data;
+  };
+
+  // The outcome of processing one chunk, error is set instead of value when it threw
+  template <typename R>
+  struct ChunkResult {
+    R value{};
+    std::string error;
+
+    bool ok() const {return error.empty();}
+  };
+
+  // The outcome of processing one file, its chunks are in file order
+  // error is set if the file could not be read at all
+  template <typename R>
+  struct FileResult {
+    std::string path;
+    std::string error;
+    std::vector<ChunkResult<R>> chunks;
+
+    bool ok() const {
+      return error.empty() && std::all_of(chunks.begin(), chunks.end(), [](const ChunkResult<R> &c) {return c.ok();});
+    }
+  };
+
+  namespace detail {
+    // Runs f, recording what it throws in error, as tasks of a WorkStealingPool must not throw
+    template <typename F>
+    void catchInto(std::string &error, F f) {
+      try {
+	f();
+      }
+      catch(const char *msg) {
+	error = msg;
+      }
+      catch(const std::exception &e) {
+	error = e.what();
+      }
+      catch(...) {
+	error = "Unknown error";
+      }
+    }
+
+    // Runs process over one chunk of file, recording its result or error
+    template <typename R, typename F>
+    void processChunk(F &process, std::string_view file, const Chunk &chunk, const ReaderLimits &limits,
+		      ChunkResult<R> &res) {
+      catchInto(res.error, [&]() {
+			     // Over the file up to the end of the chunk, so the tokenizer stops there
+			     StringTokenizer tok(StringReader(file.substr(0, chunk.offset + chunk.data.size())), limits);
+			     tok.restore({chunk.offset, chunk.depth, 0});
+			     res.value = process(tok, chunk);
+			   });
+    }
+  } // detail
+
+  // Tokenizes a list of files on a work-stealing pool, calling process(StringTokenizer &, const Chunk &) for every
+  // chunk and collecting what it returns
+  // Small files are processed whole by a single task. Large files are mapped by one task, which finds safe split
+  // points and spawns a task per chunk onto its own deque for idle workers to steal, so a few huge files spread over
+  // every core instead of holding one each. Files are queued largest first so the longest work starts early
+  // Results are returned in the order of paths, with chunks in file order, whatever order they ran in
+  // process may run concurrently with itself and must be thread-safe
+  template <typename F>
+  auto ingest(const std::vector<std::string> &paths, F process, const IngestOptions &opts = {})
+    -> std::vector<FileResult<std::decay_t<std::invoke_result_t<F &, StringTokenizer &, const Chunk &>>>> {
+    typedef std::decay_t<std::invoke_result_t<F &, StringTokenizer &, const Chunk &>> R;
+
+    std::vector<FileResult<R>> results(paths.size());
+    std::vector<std::pair<std::size_t, std::size_t>> order;	// (size, file)
+    order.reserve(paths.size());
+    for(std::size_t i = 0; i < paths.size(); ++i) {
+      results[i].path = paths[i];
+
+      struct stat st;
+      if(::stat(paths[i].c_str(), &st) < 0)
+	results[i].error = std::system_error(errno, std::generic_category(), "Cannot stat " + paths[i]).what();
+      else
+	order.emplace_back(static_cast<std::size_t>(st.st_size), i);
+    }
+    std::sort(order.begin(), order.end(), std::greater<>());
+
+    WorkStealingPool pool(opts.threads);
+    for(auto [size, file] : order) {
+      pool.submit([&, file = file]() {
+		    FileResult<R> &res = results[file];
+		    detail::catchInto(res.error, [&]() {
+		      auto mapped = std::make_shared<MappedFile>(paths[file]);
+		      std::string_view data = mapped->view();
+		      std::vector<SplitPoint> points{{0, 0}};
+		      if(opts.chunkSize && data.size() > opts.chunkSize)
+			points = findSplitPoints(data, opts.chunkSize);
+		      res.chunks.resize(points.size());
+
+		      for(std::size_t i = 0; i < points.size(); ++i) {
+			std::size_t end = i + 1 < points.size() ? points[i + 1].offset : data.size();
+			Chunk chunk{file, i, points[i].offset, points[i].depth,
+				    data.substr(points[i].offset, end - points[i].offset)};
+
+			// The last chunk is done right here, the rest wait to be stolen, each holding on to the mapping
+			if(i + 1 == points.size())
+			  detail::processChunk(process, data, chunk, opts.limits, res.chunks[i]);
+			else
+			  pool.submit([&, mapped, data, chunk]() {
+					detail::processChunk(process, data, chunk, opts.limits,
+							     results[chunk.file].chunks[chunk.index]);
+				      });
+		      }
+		    });
+		  });
+    }
+    pool.wait();
+
+    return results;
+  }
+};				// lisp_reader
+
+#endif // CPPLISPREADER_INGEST_HPP
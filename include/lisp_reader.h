@@ -0,0 +1,93 @@
+#ifndef CPPLISPREADER_LISP_READER_H
+#define CPPLISPREADER_LISP_READER_H
+
+/* C interface to the reader, for embedding it from other runtimes through liblispreader
+ * Tokens are returned in batches, written as flat arrays into buffers owned by the caller, so crossing the
+ * FFI boundary costs one call per batch rather than one per token */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#  if defined(LR_BUILDING)
+#    define LR_API __declspec(dllexport)
+#  else
+#    define LR_API __declspec(dllimport)
+#  endif
+#else
+#  define LR_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /* Token types, same order and values as lisp_reader::TokenType */
+  typedef enum lr_token_type {
+    LR_OPEN_PARENTHESIS, LR_CLOSE_PARENTHESIS, LR_SYMBOL, LR_COMMENT, LR_INT, LR_DOUBLE, LR_FLOAT, LR_FRACTION, LR_STRING
+  } lr_token_type;
+
+  /* Result of a call to lr_next_token_batch */
+  typedef enum lr_status {
+    LR_OK,			/* The batch holds at least one token */
+    LR_END,			/* No tokens are left, the batch is empty */
+    LR_ERROR,			/* The input is malformed or exceeded a limit, see lr_error */
+    LR_TEXT_TOO_SMALL,		/* A single token does not fit in the empty text buffer, retry with a larger one */
+    LR_INVALID_ARGUMENT		/* The batch has no room for tokens, or a NULL buffer, nothing was read */
+  } lr_status;
+
+  /* A single token, the value used depends on the type:
+   * SYMBOL, COMMENT, STRING: text_offset into the batch's text buffer, length characters long (not NUL terminated)
+   * INT: i, FLOAT and DOUBLE: d, FRACTION: frac
+   * OPEN_PARENTHESIS, CLOSE_PARENTHESIS: nothing */
+  typedef struct lr_token {
+    uint32_t type;
+    uint64_t length;
+    union {
+      int64_t i;
+      double d;
+      struct { int32_t num; int32_t den; } frac;
+      uint64_t text_offset;
+    } value;
+  } lr_token;
+
+  /* A batch of tokens, the caller owns both arrays and sets their capacities
+   * token_count and text_size are filled in by lr_next_token_batch */
+  typedef struct lr_batch {
+    lr_token *tokens;
+    size_t token_capacity;
+    size_t token_count;
+
+    char *text;
+    size_t text_capacity;
+    size_t text_size;
+  } lr_batch;
+
+  /* Limits on untrusted input, mirrors lisp_reader::ReaderLimits; 0 means unlimited */
+  typedef struct lr_limits {
+    size_t max_token_length;
+    size_t max_string_length;
+    size_t max_depth;
+    size_t max_tokens;
+  } lr_limits;
+
+  typedef struct lr_tokenizer lr_tokenizer;
+
+  /* Creates a tokenizer over size bytes of data, which is NOT copied and must outlive the tokenizer
+   * limits may be NULL; returns NULL if allocation fails */
+  LR_API lr_tokenizer *lr_tokenizer_new(const char *data, size_t size, const lr_limits *limits);
+
+  /* Reads as many tokens as fit into the batch, replacing its previous contents */
+  LR_API lr_status lr_next_token_batch(lr_tokenizer *tok, lr_batch *batch);
+
+  /* Message describing the last LR_ERROR, valid until the tokenizer is freed */
+  LR_API const char *lr_error(const lr_tokenizer *tok);
+
+  /* Frees a tokenizer created with lr_tokenizer_new, NULL is ignored */
+  LR_API void lr_free(lr_tokenizer *tok);
+
+#ifdef __cplusplus
+}				/* extern "C" */
+#endif
+
+#endif /* CPPLISPREADER_LISP_READER_H */
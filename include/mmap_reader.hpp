@@ -0,0 +1,89 @@
+#ifndef CPPLISPREADER_MMAP_READER_HPP
+#define CPPLISPREADER_MMAP_READER_HPP
+
+#include "reader.hpp"
+
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace lisp_reader {
+  // A whole file mapped read-only into memory, unmapped when destroyed
+  class MappedFile {
+  public:
+    explicit MappedFile(const std::string &path) : _data(nullptr), _size(0) {
+      int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if(fd < 0)
+	throw std::system_error(errno, std::generic_category(), "Cannot open " + path);
+
+      struct stat st;
+      if(::fstat(fd, &st) < 0) {
+	int err = errno;
+	::close(fd);
+	throw std::system_error(err, std::generic_category(), "Cannot stat " + path);
+      }
+
+      _size = static_cast<std::size_t>(st.st_size);
+      // Empty files cannot be mapped, they are simply read as empty
+      if(_size) {
+	void *p = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(p == MAP_FAILED) {
+	  int err = errno;
+	  ::close(fd);
+	  throw std::system_error(err, std::generic_category(), "Cannot map " + path);
+	}
+	_data = static_cast<const char *>(p);
+	// The tokenizer reads front to back
+	::madvise(p, _size, MADV_SEQUENTIAL);
+      }
+      ::close(fd);
+    }
+    MappedFile(MappedFile &&other) noexcept
+      : _data(std::exchange(other._data, nullptr)), _size(std::exchange(other._size, 0)) {}
+    MappedFile &operator=(MappedFile &&other) noexcept {
+      std::swap(_data, other._data);
+      std::swap(_size, other._size);
+      return *this;
+    }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile() {
+      if(_data) ::munmap(const_cast<char *>(_data), _size);
+    }
+
+    std::string_view view() const {return std::string_view(_data, _size);}
+    std::size_t size() const {return _size;}
+  private:
+    const char *_data;
+    std::size_t _size;
+  };
+
+  // Reads characters straight out of a memory mapped file, owning the mapping
+  // Moving the reader keeps the mapping in place, so the underlying StringReader stays valid
+  class MmapReader {
+  public:
+    explicit MmapReader(const std::string &path) : MmapReader(MappedFile(path)) {}
+    explicit MmapReader(MappedFile &&file) : _file(std::move(file)), _r(_file.view()) {}
+
+    bool read(char &c) {return _r.read(c);}
+    bool peek(char &c) const {return _r.peek(c);}
+    bool canRead() const {return _r.canRead();}
+    // Number of characters read so far
+    std::size_t offset() const {return _r.offset();}
+    void seek(std::size_t off) {_r.seek(off);}
+  private:
+    MappedFile _file;
+    StringReader _r;
+  };
+
+  // Useful typedefs
+  typedef Tokenizer<MmapReader> MmapTokenizer;
+};				// lisp_reader
+
+#endif // CPPLISPREADER_MMAP_READER_HPP
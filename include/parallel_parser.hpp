@@ -0,0 +1,178 @@
+#ifndef CPPLISPREADER_PARALLEL_PARSER_HPP
+#define CPPLISPREADER_PARALLEL_PARSER_HPP
+
+#include "reader.hpp"
+#include "mmap_reader.hpp"
+#include "split.hpp"
+#include "thread_pool.hpp"
+#include "tree.hpp"
+
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace lisp_reader {
+  // Options for ParallelParser, see below
+  struct ParallelParserOptions {
+    std::size_t threads = std::thread::hardware_concurrency();
+    // Inputs are split into chunks of about this size, 0 never splits
+    std::size_t chunkSize = 16 << 20;
+    // Apply to the whole input as they would reading it serially, except maxSymbols, which can only be set when
+    // chunkSize is 0 as every chunk interns its own symbols
+    ReaderLimits limits;
+    // Identical subtrees are only shared within a chunk
+    bool hashCons = false;
+  };
+
+  namespace detail {
+    // The tokens of a tokenizer that start before end
+    struct BoundedTokens {
+      StringTokenizer &tok;
+      std::size_t end;
+
+      bool canRead() const {return tok.canRead() && tok.offset() < end;}
+      Token read() {return tok.read();}
+      std::size_t count() const {return tok.count();}
+    };
+
+    // What one chunk read, how many tokens that took, and the error that stopped it, if any
+    struct ChunkForms {
+      std::vector<PartialItem> items;
+      std::size_t tokens = 0;
+      std::exception_ptr err;
+    };
+  } // detail
+
+  // Builds the trees of large inputs on all cores, not only their tokens
+  // The input is cut at safe points (see findSplitPoints()), and every chunk is read by a TreeBuilder of its own,
+  // concurrently, into complete forms plus markers for the lists it closes from earlier chunks and leaves open
+  // for later ones (see TreeBuilder::readPartial()). A final pass stitches the chunks together in order, building
+  // only the lists that span chunks, so it is linear in the number of forms at the edges of the chunks' nesting
+  // rather than in the number of tokens
+  // Errors are the ones reading serially would have run into first, LimitErrors with the index of the token
+  // in the whole input. Chunks count their tokens from 0, so a chunk that takes the total past maxTokens is read
+  // again once the tokens before it are known, to fail at the same token reading serially would
+  // Throws std::invalid_argument for limits.maxSymbols with a chunkSize, see ParallelParserOptions
+  class ParallelParser {
+  public:
+    explicit ParallelParser(const ParallelParserOptions &opts = {}) : _opts(opts), _pool(opts.threads) {
+      if(opts.limits.maxSymbols && opts.chunkSize)
+	throw std::invalid_argument("maxSymbols can not be enforced across chunks, set chunkSize to 0");
+    }
+
+    // Returns the top-level forms, which live as long as the parser or until the next parse
+    std::vector<const Node *> parse(std::string_view str) {
+      _builders.clear();
+
+      std::vector<SplitPoint> points{{0, 0}};
+      if(_opts.chunkSize && str.size() > _opts.chunkSize)
+	points = findSplitPoints(str, _opts.chunkSize);
+
+      std::vector<detail::ChunkForms> chunks(points.size());
+      for(std::size_t i = 0; i < points.size(); ++i)
+	_builders.push_back(std::make_unique<TreeBuilder>(_opts.hashCons, _opts.limits));
+      for(std::size_t i = 0; i < points.size(); ++i)
+	_pool.submit([&, i]() {_read(str, points, i, 0, chunks[i]);});
+      _pool.wait();
+
+      // Where each chunk starts counting tokens in the whole input
+      std::size_t before = 0;
+      for(std::size_t i = 0; i < chunks.size(); ++i) {
+	std::size_t max = _opts.limits.maxTokens;
+	if(max && chunks[i].tokens > max - before) {
+	  // Reading serially would run out of tokens in here, unless an error stops it first. No later chunk is
+	  // reached either way
+	  _builders[i] = std::make_unique<TreeBuilder>(_opts.hashCons, _opts.limits);
+	  chunks[i] = {};
+	  _read(str, points, i, before, chunks[i]);
+	  chunks.resize(i + 1);
+	  break;
+	}
+	if(chunks[i].err) {
+	  try {
+	    std::rethrow_exception(chunks[i].err);
+	  }
+	  catch(const LimitError &e) {
+	    chunks[i].err = std::make_exception_ptr(LimitError(e.limit(), e.max(), before + e.token()));
+	  }
+	  catch(...) {}
+	}
+	before += chunks[i].tokens;
+      }
+
+      return _merge(chunks);
+    }
+
+    // Parses a whole file through a memory mapping, which is let go of again once the trees are built
+    std::vector<const Node *> parseFile(const std::string &path) {
+      MappedFile file(path);
+      return parse(file.view());
+    }
+
+    std::size_t chunks() const {return _builders.empty() ? 0 : _builders.size() - 1;}
+  private:
+    ParallelParserOptions _opts;
+    WorkStealingPool _pool;
+    // One per chunk, then the one the lists spanning chunks are built by
+    std::vector<std::unique_ptr<TreeBuilder>> _builders;
+
+    // Reads chunk i of str with _builders[i], its tokens counted from count
+    void _read(std::string_view str, const std::vector<SplitPoint> &points, std::size_t i, std::size_t count,
+	       detail::ChunkForms &chunk) {
+      std::size_t end = i + 1 < points.size() ? points[i + 1].offset : str.size();
+      // Over the whole input, so the depth limit sees the global depth
+      StringTokenizer tok(StringReader(str), _opts.limits);
+      tok.restore({points[i].offset, points[i].depth, count});
+      try {
+	detail::BoundedTokens bounded{tok, end};
+	_builders[i]->readPartial(bounded, chunk.items);
+      }
+      catch(...) {
+	chunk.err = std::current_exception();
+      }
+      chunk.tokens = tok.count() - count;
+    }
+
+    std::vector<const Node *> _merge(const std::vector<detail::ChunkForms> &chunks) {
+      _builders.push_back(std::make_unique<TreeBuilder>(false, _opts.limits));
+      TreeBuilder &builder = *_builders.back();
+
+      // Like TreeBuilder::read(), with whole chunk forms in place of atoms
+      std::vector<const Node *> stack;
+      std::vector<std::size_t> frames;
+      for(const detail::ChunkForms &chunk : chunks) {
+	for(const PartialItem &item : chunk.items) {
+	  switch(item.kind) {
+	  case PartialItem::NODE:
+	    stack.push_back(item.node);
+	    break;
+	  case PartialItem::OPEN:
+	    frames.push_back(stack.size());
+	    break;
+	  case PartialItem::CLOSE: {
+	    if(frames.empty()) throw "Unexpected closing parenthesis";
+
+	    std::size_t start = frames.back();
+	    frames.pop_back();
+	    const Node *n = builder.list(stack.data() + start, stack.size() - start);
+	    stack.resize(start);
+	    stack.push_back(n);
+	    break;
+	  }
+	  }
+	}
+	// After what the chunk read before failing, which may hold an earlier error of its own
+	if(chunk.err) std::rethrow_exception(chunk.err);
+      }
+      if(!frames.empty()) throw "Missing closing parenthesis";
+
+      return stack;
+    }
+  };
+};				// lisp_reader
+
+#endif // CPPLISPREADER_PARALLEL_PARSER_HPP
@@ -0,0 +1,225 @@
+#ifndef CPPLISPREADER_PAREN_INDEX_HPP
+#define CPPLISPREADER_PAREN_INDEX_HPP
+
+#include "reader.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+// SSE2 is part of x86-64, anything else classifies bytes one at a time
+#if defined(__SSE2__) && !defined(LISP_READER_NO_SIMD)
+#define LISP_READER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace lisp_reader {
+  namespace detail {
+    // Number of characters the grammar escapes atoms with, see dfa::escapesNext() and dfa::quotes()
+    constexpr std::size_t escapeChars() {
+      std::size_t n = 0;
+      for(int i = 0; i < 256; ++i) n += dfa::stopAction(static_cast<char>(i)) == dfa::ESCAPE;
+      return n;
+    }
+
+    // Characters that can change where the parenthesis are: the parenthesis themselves, whatever starts or ends
+    // a string or a comment, and the grammar's escapes, like backslashes and |escaped| sections
+    constexpr std::array<char, 5 + escapeChars()> structuralChars() {
+      std::array<char, 5 + escapeChars()> ret{
+	token_chars::OPEN_PARENTHESIS, token_chars::CLOSE_PARENTHESIS, token_chars::STRING, token_chars::COMMENT, '\n'
+      };
+      std::size_t n = 5;
+      for(int i = 0; i < 256; ++i)
+	if(dfa::stopAction(static_cast<char>(i)) == dfa::ESCAPE) ret[n++] = static_cast<char>(i);
+      return ret;
+    }
+    inline constexpr std::array<char, 5 + escapeChars()> STRUCTURAL_CHARS = structuralChars();
+
+    // Bit i is set when p[i] is structural, for 64 bytes at p
+    inline std::uint64_t structuralBitsScalar(const char *p) {
+      std::uint64_t ret = 0;
+      for(int i = 0; i < 64; ++i)
+	for(char c : STRUCTURAL_CHARS)
+	  if(p[i] == c) ret |= std::uint64_t(1) << i;
+
+      return ret;
+    }
+
+    inline std::uint64_t structuralBits(const char *p) {
+#ifdef LISP_READER_SSE2
+      std::uint64_t ret = 0;
+      for(int i = 0; i < 4; ++i) {
+	__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16 * i));
+	__m128i hit = _mm_setzero_si128();
+	for(char c : STRUCTURAL_CHARS)
+	  hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+	ret |= static_cast<std::uint64_t>(static_cast<std::uint16_t>(_mm_movemask_epi8(hit))) << (16 * i);
+      }
+      return ret;
+#else
+      return structuralBitsScalar(p);
+#endif
+    }
+  } // detail
+
+  // A structural index of the parenthesis of an input: where each one is, its nesting depth and its match
+  // Parenthesis in strings, comments and |escaped| sections or escaped with a backslash are not part of it, the
+  // same ones Tokenizer reads as such, with the escapes taken from the grammar. Building it classifies 64 bytes at a time with SSE2 and only looks at
+  // the structural characters found, so runs of symbols, numbers and text cost a few instructions per block
+  // Lookups by offset take O(1): a bitmap of the parenthesis, with the number of them before each word, gives
+  // the rank of any of them
+  class ParenIndex {
+  public:
+    static constexpr std::size_t npos = std::string_view::npos;
+
+    explicit ParenIndex(std::string_view str) : _size(str.size()), _unmatched(npos) {
+      _bits.assign(str.size() / 64 + 1, 0);
+      _build(str);
+      _rank.resize(_bits.size());
+      for(std::size_t i = 0, n = 0; i < _bits.size(); ++i) {
+	_rank[i] = n;
+	n += __builtin_popcountll(_bits[i]);
+      }
+    }
+
+    // Number of parenthesis, and their offsets, in order
+    std::size_t size() const {return _offsets.size();}
+    const std::vector<std::size_t> &offsets() const {return _offsets;}
+
+    // Whether every parenthesis has a match
+    bool balanced() const {return _unmatched == npos;}
+    // Offset of the first parenthesis without a match, npos if balanced
+    std::size_t firstUnmatched() const {return _unmatched;}
+
+    // Whether there is an indexed parenthesis at offset
+    bool isParen(std::size_t offset) const {
+      return offset < _size && (_bits[offset / 64] >> (offset % 64) & 1);
+    }
+    // Offset of the parenthesis matching the one at offset, npos if it has none or there is none at offset
+    std::size_t match(std::size_t offset) const {
+      if(!isParen(offset)) return npos;
+      std::size_t m = _match[_indexOf(offset)];
+      return m == npos ? npos : _offsets[m];
+    }
+    // Nesting depth of the list the parenthesis at offset opens or closes, 1 for top-level lists
+    // Like Tokenizer::depth() right after an opening parenthesis, or right before a closing one
+    std::size_t depth(std::size_t offset) const {return isParen(offset) ? _depth[_indexOf(offset)] : 0;}
+
+    // Moves a tokenizer that just read an opening parenthesis past the rest of its list, which is not read,
+    // so it only counts the tokens it does read. Returns false, without moving it, if the list is never closed
+    template <typename T>
+    bool skipList(Tokenizer<T> &tok) const {
+      std::size_t close = match(tok.span().first);
+      if(close == npos || close < tok.span().first) return false;
+
+      Checkpoint cp = tok.checkpoint();
+      tok.restore({close + 1, cp.depth - 1, cp.count});
+      return true;
+    }
+  private:
+    std::size_t _size;
+    std::size_t _unmatched;
+    std::vector<std::uint64_t> _bits;
+    // Number of parenthesis before each word of _bits
+    std::vector<std::size_t> _rank;
+    // By index of the parenthesis
+    std::vector<std::size_t> _offsets;
+    std::vector<std::size_t> _match;
+    std::vector<std::uint32_t> _depth;
+
+    std::size_t _indexOf(std::size_t offset) const {
+      std::uint64_t below = _bits[offset / 64] & ((std::uint64_t(1) << (offset % 64)) - 1);
+      return _rank[offset / 64] + __builtin_popcountll(below);
+    }
+
+    // One pass over the structural characters, a state machine like detail::walkSafePoints() runs
+    void _build(std::string_view str) {
+      enum { NORMAL, STRING, QUOTED, COMMENT } state = NORMAL;
+      // The character that opened the QUOTED section, which also closes it
+      char quote = 0;
+      // Offset right after an escaped character
+      std::size_t skip = 0;
+      // Open parenthesis without a match yet
+      std::vector<std::size_t> open;
+
+      char tail[64];
+      for(std::size_t base = 0; base < str.size(); base += 64) {
+	const char *block = str.data() + base;
+	// The last block is padded with a character that is never structural
+	if(str.size() - base < 64) {
+	  std::memset(tail, ' ', sizeof(tail));
+	  std::memcpy(tail, block, str.size() - base);
+	  block = tail;
+	}
+
+	for(std::uint64_t bits = detail::structuralBits(block); bits; bits &= bits - 1) {
+	  std::size_t i = base + __builtin_ctzll(bits);
+	  if(i < skip) continue;
+
+	  char c = str[i];
+	  switch(state) {
+	  case NORMAL:
+	    switch(c) {
+	    case token_chars::OPEN_PARENTHESIS:
+	      open.push_back(_add(i, open.size() + 1));
+	      break;
+	    case token_chars::CLOSE_PARENTHESIS:
+	      if(open.empty()) {
+		_add(i, 0);
+		if(_unmatched == npos) _unmatched = i;
+	      }
+	      else {
+		std::size_t o = open.back();
+		open.pop_back();
+		std::size_t close = _add(i, open.size() + 1);
+		_match[o] = close;
+		_match[close] = o;
+	      }
+	      break;
+	    case token_chars::STRING:
+	      state = STRING;
+	      break;
+	    case token_chars::COMMENT:
+	      state = COMMENT;
+	      break;
+	    default:
+	      if(dfa::escapesNext(c))
+		skip = i + 2;
+	      else if(dfa::quotes(c)) {
+		state = QUOTED;
+		quote = c;
+	      }
+	      break;
+	    }
+	    break;
+	  case STRING:
+	    if(c == token_chars::STRING) state = NORMAL;
+	    break;
+	  case QUOTED:
+	    if(c == quote) state = NORMAL;
+	    break;
+	  case COMMENT:
+	    if(c == '\n') state = NORMAL;
+	    break;
+	  }
+	}
+      }
+
+      if(!open.empty() && (_unmatched == npos || _offsets[open.front()] < _unmatched))
+	_unmatched = _offsets[open.front()];
+    }
+
+    // Records a parenthesis, returning its index
+    std::size_t _add(std::size_t offset, std::size_t depth) {
+      _bits[offset / 64] |= std::uint64_t(1) << (offset % 64);
+      _offsets.push_back(offset);
+      _match.push_back(npos);
+      _depth.push_back(static_cast<std::uint32_t>(depth));
+      return _offsets.size() - 1;
+    }
+  };
+};				// lisp_reader
+
+#endif // CPPLISPREADER_PAREN_INDEX_HPP
@@ -0,0 +1,141 @@
+#ifndef CPPLISPREADER_PERF_COUNTERS_HPP
+#define CPPLISPREADER_PERF_COUNTERS_HPP
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#ifdef __linux__
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace lisp_reader {
+  // Hardware counters we know how to read
+  enum class PerfCounter { CYCLES, INSTRUCTIONS, BRANCH_MISSES, CACHE_MISSES, L1D_MISSES, END };
+  // Labels for each of the above counters
+  inline const std::array<std::string, static_cast<int>(PerfCounter::END)> perfCounterLabels{
+    "cycles", "instructions", "branch-misses", "cache-misses", "L1D-misses"
+      };
+
+  // Counter values, indexed by PerfCounter, only meaningful for the counters that are available
+  struct PerfSample {
+    std::array<std::uint64_t, static_cast<int>(PerfCounter::END)> values{};
+
+    std::uint64_t operator[](PerfCounter c) const {return values[static_cast<int>(c)];}
+    PerfSample &operator+=(const PerfSample &rhs) {
+      for(std::size_t i = 0; i < values.size(); ++i) values[i] += rhs.values[i];
+      return *this;
+    }
+    PerfSample operator-(const PerfSample &rhs) const {
+      PerfSample ret;
+      for(std::size_t i = 0; i < values.size(); ++i) ret.values[i] = values[i] - rhs.values[i];
+      return ret;
+    }
+  };
+
+  // User-space hardware counters of the calling thread, opened through perf_event_open as one group so they
+  // all cover exactly the same instructions
+  // Counters the CPU, kernel or container does not offer are left out, and when none can be opened at all
+  // (no PMU, perf_event_paranoid, seccomp, not Linux) available() is false, error() says why, and the
+  // counters read as zeros. Callers can use it unconditionally and report whatever is there
+  // Counts are scaled up if the kernel had to multiplex the group
+  class PerfCounters {
+  public:
+    PerfCounters() {
+      _fds.fill(-1);
+#ifdef __linux__
+      static const std::array<std::pair<std::uint32_t, std::uint64_t>, static_cast<int>(PerfCounter::END)> events{{
+	  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+	  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+	  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+	  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+	  {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+	   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)}
+	}};
+
+      for(std::size_t i = 0; i < events.size(); ++i) {
+	perf_event_attr attr;
+	std::memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = events[i].first;
+	attr.config = events[i].second;
+	attr.disabled = _leader < 0;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+	int fd = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, _leader, 0));
+	if(fd < 0) {
+	  if(_error.empty()) _error = perfCounterLabels[i] + ": " + std::strerror(errno);
+	  continue;
+	}
+	if(_leader < 0) _leader = fd;
+	_fds[i] = fd;
+	_slot[i] = _count++;
+      }
+#else
+      _error = "perf_event_open is only available on Linux";
+#endif
+    }
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+    ~PerfCounters() {
+#ifdef __linux__
+      for(int fd : _fds)
+	if(fd >= 0) ::close(fd);
+#endif
+    }
+
+    bool available() const {return _leader >= 0;}
+    bool has(PerfCounter c) const {return _fds[static_cast<int>(c)] >= 0;}
+    // Why the first counter that failed to open did, empty if they all opened
+    const std::string &error() const {return _error;}
+
+    // Resets the counters to zero and starts counting
+    void start() {
+#ifdef __linux__
+      if(!available()) return;
+      ::ioctl(_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+      ::ioctl(_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    }
+    void stop() {
+#ifdef __linux__
+      if(available()) ::ioctl(_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    }
+
+    // Current counts since the last start(), counting need not be stopped
+    PerfSample read() const {
+      PerfSample ret;
+#ifdef __linux__
+      if(!available()) return ret;
+
+      // {nr, time_enabled, time_running, values[nr]}
+      std::array<std::uint64_t, 3 + static_cast<int>(PerfCounter::END)> buf{};
+      if(::read(_leader, buf.data(), sizeof(buf)) < static_cast<ssize_t>((3 + _count) * sizeof(std::uint64_t)))
+	return ret;
+
+      double scale = buf[2] && buf[2] < buf[1] ? static_cast<double>(buf[1]) / buf[2] : 1.0;
+      for(std::size_t i = 0; i < _fds.size(); ++i)
+	if(_fds[i] >= 0)
+	  ret.values[i] = static_cast<std::uint64_t>(buf[3 + _slot[i]] * scale);
+#endif
+      return ret;
+    }
+  private:
+    std::array<int, static_cast<int>(PerfCounter::END)> _fds;
+    // Position of each counter in the group's read buffer
+    std::array<std::size_t, static_cast<int>(PerfCounter::END)> _slot{};
+    std::size_t _count = 0;
+    int _leader = -1;
+    std::string _error;
+  };
+};				// lisp_reader
+
+#endif // CPPLISPREADER_PERF_COUNTERS_HPP
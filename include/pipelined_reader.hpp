@@ -0,0 +1,77 @@
+#ifndef CPPLISPREADER_PIPELINED_READER_HPP
+#define CPPLISPREADER_PIPELINED_READER_HPP
+
+#include "reader.hpp"
+#include "chunk_reader.hpp"
+
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace lisp_reader {
+  // An open file descriptor, closed when destroyed
+  class FileHandle {
+  public:
+    explicit FileHandle(const std::string &path) : _fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC)) {
+      if(_fd < 0)
+	throw std::system_error(errno, std::generic_category(), "Cannot open " + path);
+      ::posix_fadvise(_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    FileHandle(FileHandle &&other) noexcept : _fd(std::exchange(other._fd, -1)) {}
+    FileHandle &operator=(FileHandle &&other) noexcept {
+      std::swap(_fd, other._fd);
+      return *this;
+    }
+    FileHandle(const FileHandle &) = delete;
+    FileHandle &operator=(const FileHandle &) = delete;
+    ~FileHandle() {
+      if(_fd >= 0) ::close(_fd);
+    }
+
+    int fd() const {return _fd;}
+
+    // Reads into buf at off, retrying interrupted calls, returns 0 at the end of the file
+    std::size_t pread(char *buf, std::size_t cap, std::size_t off) const {
+      for(;;) {
+	ssize_t n = ::pread(_fd, buf, cap, static_cast<off_t>(off));
+	if(n >= 0) return static_cast<std::size_t>(n);
+	if(errno != EINTR)
+	  throw std::system_error(errno, std::generic_category(), "Cannot read file");
+      }
+    }
+  private:
+    int _fd;
+  };
+
+  // Produces a file front to back with pread, for ProducerSource
+  class PreadProducer {
+  public:
+    explicit PreadProducer(const std::string &path) : _file(path), _off(0) {}
+
+    std::size_t fill(char *buf, std::size_t cap) {
+      std::size_t n = _file.pread(buf, cap, _off);
+      _off += n;
+      return n;
+    }
+  private:
+    FileHandle _file;
+    std::size_t _off;
+  };
+
+  // Reads a file in fixed-size chunks, with the next chunks already being read while the current one is tokenized
+  // Chunks are read with pread on a helper thread into a ring of depth buffers, so throughput approaches the slower
+  // of the disk and the lexer rather than their sum
+  class PipelinedFileReader : public ChunkReader<ProducerSource<PreadProducer>> {
+  public:
+    explicit PipelinedFileReader(const std::string &path, std::size_t chunkSize = 1 << 20, std::size_t depth = 2)
+      : ChunkReader(PreadProducer(path), chunkSize, true, depth) {}
+  };
+
+  // Useful typedefs
+  typedef Tokenizer<PipelinedFileReader> PipelinedTokenizer;
+};				// lisp_reader
+
+#endif // CPPLISPREADER_PIPELINED_READER_HPP
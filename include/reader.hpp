@@ -1,13 +1,26 @@
 #ifndef CPPLISPREADER_READER_HPP
 #define CPPLISPREADER_READER_HPP
 
+// The Tokenizer for the stock readers (StringTokenizer, StreamTokenizer) is explicitly instantiated in src/reader.cpp,
+// which is compiled into the lisp_reader library. Define LISP_READER_HEADER_ONLY to use this header on its own instead
+
+#include "small_string.hpp"
+
 #include <iostream>
+#include <memory_resource>
 #include <string_view>
 #include <algorithm>
 #include <string>
 #include <optional>
 #include <variant>
+#include <array>
 #include <exception>
+#include <stdexcept>
+#include <cerrno>
+#include <cstdint>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
 
 namespace lisp_reader {
   // Represent different types of tokens
@@ -15,12 +28,12 @@ namespace lisp_reader {
   // Every TokenType after COMMENT (INT-STRING) is a literal
   enum class TokenType { OPEN_PARENTHESIS, CLOSE_PARENTHESIS, SYMBOL, COMMENT, INT, DOUBLE, FLOAT, FRACTION, STRING, END };
   // Labels for each of the above Token Types
-  const std::array<std::string, static_cast<int>(TokenType::END)> tokenTypeLabels{
+  inline const std::array<std::string, static_cast<int>(TokenType::END)> tokenTypeLabels{
     "OPEN_PARENTHESIS", "CLOSE_PARENTHESIS", "SYMBOL", "COMMENT", "INT", "DOUBLE", "FLOAT", "FRACTION", "STRING"
       };
 
   // Function that returns the label for a given TokenType, used to contain the static_cast's
-  std::string_view getLabel(TokenType tt) {
+  inline std::string_view getLabel(TokenType tt) {
     return tokenTypeLabels[static_cast<int>(tt)];
   }
 
@@ -28,6 +41,7 @@ namespace lisp_reader {
   // This class allows printing, and keeps fraction simplified
   class Fraction {
   public:
+    // Throws std::invalid_argument for a zero denominator
     Fraction(int num, int den)
       : _num(num), _den(den) {
       _simplify();
@@ -62,6 +76,9 @@ namespace lisp_reader {
     }
 
     void _simplify() {
+      // Would divide by the zero gcd below
+      if(_den == 0)
+	throw std::invalid_argument("Fraction with zero denominator");
       int gcd = _gcd(_num, _den);
 
       _num /= gcd;
@@ -69,16 +86,17 @@ namespace lisp_reader {
     }
   };
 
-  std::ostream &operator<<(std::ostream &os, const Fraction &frac) {
-    os << frac.getNum() << '/' << frac.getDen();
+  inline std::ostream &operator<<(std::ostream &os, const Fraction &frac) {
+    return os << frac.getNum() << '/' << frac.getDen();
   }
 
   // The value of a token, can be any one of these
-  typedef std::variant<std::string, int, float, double, Fraction> TokenValue;
+  // Text is held in a SmallString, so typical symbols never allocate
+  typedef std::variant<SmallString, int, float, double, Fraction> TokenValue;
   // Use a bit of type traits to define what each TokenType maps to in the variant
   // By default it contains a string
   template <TokenType T>
-  struct TokenTypeValue { typedef std::string ValType; };
+  struct TokenTypeValue { typedef SmallString ValType; };
   template <>
   struct TokenTypeValue<TokenType::INT> { typedef int ValType; };
   template <>
@@ -102,15 +120,183 @@ namespace lisp_reader {
     constexpr char COMMENT           = ';';
   } // token_chars
 
+  namespace detail {
+    // Parse the NUL terminated text of numeric tokens, throwing like std::stoi and friends do:
+    // std::out_of_range when the value does not fit, std::invalid_argument when the text is not all number
+    // stop is the character the number has to end at
+    inline void checkParsed(const char *str, const char *end, char stop, const char *what) {
+      if(end == str || *end != stop)
+	throw std::invalid_argument(what);
+    }
+    inline int parseInt(const char *str, char stop = '\0') {
+      errno = 0;
+      char *end;
+      long v = std::strtol(str, &end, 10);
+      // Integers may end in a dot, like 1.
+      if(end != str && *end == '.') ++end;
+      checkParsed(str, end, stop, "Invalid integer literal");
+      if(errno == ERANGE || v < INT_MIN || v > INT_MAX)
+	throw std::out_of_range("Integer literal out of range");
+      return static_cast<int>(v);
+    }
+    inline float parseFloat(const char *str) {
+      errno = 0;
+      char *end;
+      float v = std::strtof(str, &end);
+      checkParsed(str, end, '\0', "Invalid float literal");
+      if(errno == ERANGE)
+	throw std::out_of_range("Float literal out of range");
+      return v;
+    }
+    inline double parseDouble(const char *str) {
+      errno = 0;
+      char *end;
+      double v = std::strtod(str, &end);
+      checkParsed(str, end, '\0', "Invalid double literal");
+      if(errno == ERANGE)
+	throw std::out_of_range("Double literal out of range");
+      return v;
+    }
+    // Fractions are num/den, den must not be zero
+    inline Fraction parseFraction(const char *str) {
+      // Parse each side of the slash as an int, the first stops at the slash
+      int num = parseInt(str, '/');
+      int den = parseInt(std::strchr(str, '/') + 1);
+      if(den == 0)
+	throw std::invalid_argument("Fraction with zero denominator");
+      return Fraction(num, den);
+    }
+
+    // Replaces the text of a numeric token, already classified as type, with its value
+    // A fraction that turns out to be whole becomes an INT
+    inline void parseNumber(TokenType &type, TokenValue &value) {
+      SmallString &val = std::get<SmallString>(value);
+      switch(type) {
+      case TokenType::INT:
+	value = parseInt(val.c_str());
+	break;
+      case TokenType::FLOAT:
+	value = parseFloat(val.c_str());
+	break;
+      case TokenType::DOUBLE:
+	val[val.find('d')] = 'e';
+	value = parseDouble(val.c_str());
+	break;
+      case TokenType::FRACTION:
+	{
+	  Fraction f = parseFraction(val.c_str());
+	  if(f.isInt()) {
+	    type = TokenType::INT;
+	    value = f.getNum();
+	  }
+	  else
+	    value = f;
+	}
+	break;
+      default:
+	break;
+      }
+    }
+  } // detail
+
   // Represent both a type and whatever value it may contain, some tokens may not have any value
   typedef std::pair<TokenType, std::optional<TokenValue> > Token;
 
   // For symbol tokens, these characters MUST be escaped
-  const std::array<char, 10> RESERVED_SYM_CHARS{ '(', ')', '"', '\'', '`', ',', ':', ';', '\\', '|' };
+  inline constexpr std::array<char, 10> RESERVED_SYM_CHARS{ '(', ')', '"', '\'', '`', ',', ':', ';', '\\', '|' };
+
+  // The minimal DFA classifying atoms, generated at build time by gen_dfa from grammar/atoms.grammar
+  namespace dfa {
+#include "atom_dfa.inc"
+
+    // What the DFA does with a character that stops it, END_ATOM, ESCAPE or ILLEGAL, which is the same from
+    // every state. Characters that do not stop it get a scanning state
+    constexpr std::uint8_t stopAction(char c) {return transitions[START][classes[static_cast<unsigned char>(c)]];}
+
+    // The two kinds of ESCAPE, as both tokenizers read them: a BACKSLASH escapes the character after it, any
+    // other escape quotes everything up to the next one of itself, like |a b|
+    // For code that has to find where atoms end without tokenizing, so it follows the grammar as well
+    constexpr bool escapesNext(char c) {
+      return stopAction(c) == ESCAPE && classes[static_cast<unsigned char>(c)] == BACKSLASH;
+    }
+    constexpr bool quotes(char c) {
+      return stopAction(c) == ESCAPE && classes[static_cast<unsigned char>(c)] != BACKSLASH;
+    }
+  } // dfa
+
+  namespace detail {
+    constexpr bool isSpace(char c) {
+      return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+    }
+
+    // Whether the grammar stops atoms on the characters the tokenizers expect: whitespace (the SPACE class)
+    // and the characters starting other tokens end them, the rest of RESERVED_SYM_CHARS escape them or are
+    // illegal, and nothing else stops them
+    constexpr bool atomStopsMatch() {
+      for(int i = 0; i < 256; ++i) {
+	char c = static_cast<char>(i);
+	bool token = c == token_chars::OPEN_PARENTHESIS || c == token_chars::CLOSE_PARENTHESIS ||
+	  c == token_chars::STRING || c == token_chars::COMMENT;
+	bool reserved = false;
+	for(char r : RESERVED_SYM_CHARS) reserved |= r == c;
+
+	std::uint8_t action = dfa::stopAction(c);
+	if((dfa::classes[static_cast<unsigned char>(c)] == dfa::SPACE) != isSpace(c) ||
+	   (action == dfa::END_ATOM) != (isSpace(c) || token) ||
+	   (action == dfa::ESCAPE || action == dfa::ILLEGAL) != (reserved && !token))
+	  return false;
+      }
+      return true;
+    }
+  } // detail
+  static_assert(detail::atomStopsMatch(), "grammar/atoms.grammar must stop atoms where the tokenizers expect it to");
 
   // Different ways of escaping a sequence
   enum class Escapes{NONE, BACKSLASH, PIPE};
 
+  // Limits on untrusted input, enforced by the Tokenizer while reading
+  // A limit of 0 means unlimited, which is the default for all of them
+  struct ReaderLimits {
+    std::size_t maxTokenLength = 0;	// Characters in any single token
+    std::size_t maxStringLength = 0;	// Characters in a string literal, on top of maxTokenLength
+    std::size_t maxDepth = 0;		// Nesting depth of parenthesis
+    std::size_t maxTokens = 0;		// Total number of tokens read
+    std::size_t maxSymbols = 0;		// Distinct symbols interned, enforced by ValueArena when building trees
+  };
+
+  // Where a Tokenizer is between two tokens, see Tokenizer::checkpoint()
+  // Plain numbers, so it can be stored and used to resume on the same input in another process
+  struct Checkpoint {
+    std::size_t offset = 0;	// Of the next token into the input
+    std::size_t depth = 0;
+    std::size_t count = 0;	// Tokens read before
+  };
+
+  // Identifies which of the ReaderLimits was exceeded
+  enum class Limit { TOKEN_LENGTH, STRING_LENGTH, DEPTH, TOKENS, SYMBOLS, END };
+  // Labels for each of the above Limits
+  inline const std::array<std::string, static_cast<int>(Limit::END)> limitLabels{
+    "TOKEN_LENGTH", "STRING_LENGTH", "DEPTH", "TOKENS", "SYMBOLS"
+      };
+
+  // Thrown when the input exceeds one of the ReaderLimits
+  // Carries which limit was hit, its configured value and the index of the offending token
+  class LimitError : public std::length_error {
+  public:
+    LimitError(Limit limit, std::size_t max, std::size_t token)
+      : std::length_error("Reader limit " + limitLabels[static_cast<int>(limit)] + " of " + std::to_string(max) +
+			  " exceeded at token " + std::to_string(token)),
+	_limit(limit), _max(max), _token(token) {}
+
+    Limit limit() const {return _limit;}
+    std::size_t max() const {return _max;}
+    std::size_t token() const {return _token;}
+  private:
+    Limit _limit;
+    std::size_t _max;
+    std::size_t _token;
+  };
+
   // Helper function for printing a type-value token pair
   inline std::ostream &operator<<(std::ostream &os, const Token &t) {
     // If it's a literal type add this for extra information
@@ -138,13 +324,26 @@ namespace lisp_reader {
   // Represents an arbitrary reader that can be used to read characters from any input stream reference
   class StreamReader {
   public:
-    StreamReader(std::istream &is) : _is(is) {std::noskipws(_is);}
+    StreamReader(std::istream &is) : _is(is), _off(0), _base(is.tellg()) {std::noskipws(_is);}
 
-    bool read(char &c) {_is.get() >> c; return static_cast<bool>(_is.get());}
-    bool peek(char &c) const {c = _is.get().peek(); return static_cast<bool>(_is.get());}
+    bool read(char &c) {_is.get() >> c; bool suc = static_cast<bool>(_is.get()); _off += suc; return suc;}
+    bool peek(char &c) const {c = _is.get().peek(); return _is.get().good();}
     bool canRead() const {_is.get().peek(); return _is.get().good();}
+    // Number of characters read so far
+    std::size_t offset() const {return _off;}
+    // Moves to off characters past where the reader started, only for seekable streams like files
+    void seek(std::size_t off) {
+      _is.get().clear();
+      if(_base < 0 || !_is.get().seekg(_base + static_cast<std::streamoff>(off)))
+	throw std::runtime_error("Cannot seek in this stream");
+      _off = off;
+    }
   private:
     std::reference_wrapper<std::istream> _is;
+
+    std::size_t _off;
+    // Position of the stream when the reader started, -1 if it cannot seek
+    std::streamoff _base;
   };
 
   // Specialization of the above to allow for reading from strings directly without constructing an intermediate stream object
@@ -168,296 +367,403 @@ namespace lisp_reader {
       return true;
     }
     bool canRead() const {return cntr < _str.size();}
+    // Number of characters read so far
+    std::size_t offset() const {return cntr;}
+    // Moves to off characters into the string, or its end
+    void seek(std::size_t off) {cntr = std::min(off, _str.size());}
   private:
     std::string_view _str;
 
     std::size_t cntr;
   };
 
+  // Base for the handlers of Tokenizer::readEvent(), with a callback for every kind of token
+  // A handler derives from EventHandler<Handler> and defines the callbacks it cares about, the rest do nothing
+  // The tokenizer calls them on the handler's own type, so they are resolved statically and inline into it
+  // Text is only valid during the call
+  template <typename Derived>
+  struct EventHandler {
+    void onOpen() {}
+    void onClose() {}
+    void onSymbol(std::string_view) {}
+    void onString(std::string_view) {}
+    void onComment(std::string_view) {}
+    void onInt(int) {}
+    // Widened to a double, unless the handler takes floats itself
+    void onFloat(float f) {static_cast<Derived &>(*this).onDouble(f);}
+    void onDouble(double) {}
+    // Whole fractions are INTs, like in tokens
+    void onFraction(const Fraction &) {}
+  };
+
   // Takes in a stream and produces tokens for consumption
+  // Token text too long to be kept inline is allocated from resource, so the tokens read must not outlive it
   template <typename T>
   class Tokenizer {
   public:
-    Tokenizer(T &&r)
-      : _r(std::move(r)) {}
+    Tokenizer(T &&r, ReaderLimits limits = {}, std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : _r(std::move(r)), _limits(limits), _resource(resource), _depth(0), _count(0), _start(0), _end(0), _more(false) {
+      _skipSpace();
+    }
 
     // Check if we can (or have) any more tokens to read by peeking a single character ahead and checking stream state
+    // Whitespace after every token is consumed eagerly, so this only reports actual tokens
     bool canRead() const {return _r.canRead();}
 
     // Reads a token from the input stream
     // NOTE: Undefined behavior if read without checking canRead() first
-    Token read() {
-      // Reset the token value to a symbol with empty string
-      _ret = Token{TokenType::SYMBOL, ""};
-
-      char c;
-      _r.peek(c);
-      // Based on the first character we find, the rest of the characters must be parsed accordingly
-      switch(c) {
-      case token_chars::OPEN_PARENTHESIS: // Parse Open Parenthesis
-	_ret.first = TokenType::OPEN_PARENTHESIS;
-	_ret.second = std::nullopt;
-	// Consume the character
-	_r.read(c);
-	break;
-      case token_chars::CLOSE_PARENTHESIS: // Parse Close Parenthesis
-	_ret.first = TokenType::CLOSE_PARENTHESIS;
-	_ret.second = std::nullopt;
-	// Consume the character
-	_r.read(c);
-	break;
-      case token_chars::STRING:	// Parse String
-	_ret.first = TokenType::STRING;
-	// Read a string into ret
-	_readStr();
-	break;
-      case token_chars::COMMENT: // Parse Comment
-	_ret.first = TokenType::COMMENT;
-	// Read a comment into ret
-	_readCmt();
-	break;
-      default:			// Can be either a symbol or a number here
-	_statefulRead();
-	break;
-      }
+    Token read();
+    Token peek() const;
 
-      // Return the token here
-      return _ret;
+    // Reads a token like read() does, with the same limits and errors, but hands it to handler instead
+    // No Token is built: text goes to a buffer reused from one token to the next and numbers are parsed
+    // straight out of it, so once that buffer has grown reading allocates nothing
+    // NOTE: Undefined behavior if read without checking canRead() first
+    template <typename H>
+    void readEvent(H &handler);
+    // Reads every remaining token as events
+    template <typename H>
+    void readEvents(H &handler) {while(canRead()) readEvent(handler);}
+
+    // Current nesting depth of parenthesis, and number of tokens read so far
+    std::size_t depth() const {return _depth;}
+    std::size_t count() const {return _count;}
+    // Offsets into the input of the last token read, as [first, second)
+    std::pair<std::size_t, std::size_t> span() const {return {_start, _end};}
+    // Offset of the reader into the input, where the next token starts or where an error was found
+    std::size_t offset() const {return _r.offset();}
+
+    // Captures the position between two tokens, restore() goes back to it, or ahead
+    // Tokens are read whole, so the reader's offset, the depth and the count are all there is to it
+    Checkpoint checkpoint() const {return {_r.offset(), _depth, _count};}
+    // Only for readers that can seek, in O(1) for strings and memory mapped files
+    // Resuming in another Tokenizer over the same input works too, the limits apply to the restored count
+    void restore(const Checkpoint &cp) {
+      _r.seek(cp.offset);
+      _depth = cp.depth;
+      _count = cp.count;
+      _start = _end = _r.offset();
+      // Lets a checkpoint made up from any byte offset start at a token
+      _skipSpace();
     }
-    Token peek() const;
   private:
     T _r;
     // The current token being constructed, we fill this up while parsing
     Token _ret;
+    // Text of the current event, see readEvent()
+    SmallString _text;
+    ReaderLimits _limits;
+    std::pmr::memory_resource *_resource;
+    std::size_t _depth;
+    std::size_t _count;
+    std::size_t _start;
+    std::size_t _end;
+    // Whether _skipSpace() stopped at a character rather than at the end of the input
+    bool _more;
+
+    template <typename> friend class TokenRange;
+
+    // A list of private helper methods, they read the text of the token into val
+    void _readStr(SmallString &val);
+    void _readCmt(SmallString &val);
 
-    // A list of private helper methods
-    void _readStr() {
-      char c;
-      _r.read(c);
-      if(c != token_chars::STRING)
-	throw "Missing double-quotes at start of string literal";
-
-      // Consume characters until we hit a "
-      std::string &val = getTokenVal<TokenType::STRING>(*_ret.second);
-      while(_r.read(c) && c != token_chars::STRING)
-        val.push_back(c);
-      if(c != token_chars::STRING)
-	throw "Missing closing double-quotes for string literal";
+    // Will attempt to determine whether a space-delimited word is a numeric type or symbol
+    // Runs the atom DFA generated from grammar/atoms.grammar, one table lookup per character
+    // Returns the type, numbers are left as text to be parsed
+    TokenType _statefulRead(SmallString &val);
+
+    // Common to read() and readEvent(), before and after reading the token itself
+    void _begin() {
+      // Checked up front, so a flood of tokens fails before any of them is built
+      if(_limits.maxTokens && _count >= _limits.maxTokens)
+	throw LimitError(Limit::TOKENS, _limits.maxTokens, _count);
+
+      _start = _r.offset();
+    }
+    void _finish() {
+      // Consume whitespace up to the next token
+      _end = _r.offset();
+      _skipSpace();
+      ++_count;
+    }
+    void _open() {
+      if(_limits.maxDepth && _depth >= _limits.maxDepth)
+	throw LimitError(Limit::DEPTH, _limits.maxDepth, _count);
+      ++_depth;
     }
-    void _readCmt() {
-      // Read until we stop finding ';'
-      char c;
-      _r.read(c);
 
-      // If the first character is not a comment character, throw an error
-      if(c != token_chars::COMMENT)
-	throw "Missing semicolon at start of comment";
+    // Returns the length limit that applies to a token, along with which limit it is
+    std::pair<Limit, std::size_t> _lengthLimit(Limit limit) const {
+      std::size_t max = _limits.maxTokenLength;
+      if(limit == Limit::STRING_LENGTH && _limits.maxStringLength && (!max || _limits.maxStringLength < max))
+	return {Limit::STRING_LENGTH, _limits.maxStringLength};
 
-      // Keep reading characters until we hit a non-COMMENT one or EOF
-      while(!_r.read(c) || c == token_chars::COMMENT);
+      return {Limit::TOKEN_LENGTH, max};
+    }
 
-      // Start reading the actual comment, can be done quickly with getline
-      std::string &val = getTokenVal<TokenType::COMMENT>(*_ret.second);
-      val.push_back(c);
-      while(_r.read(c) && c != '\n') val.push_back(c);
+    // Appends a character to the token being read, enforcing the length limits
+    // The limit is only checked when the buffer is full, and the buffer never grows past the limit,
+    // so this costs O(log n) checks per token while still never allocating more than allowed
+    // Growth happens here rather than in push_back, so every buffer comes from our resource
+    void _push(SmallString &val, char c, Limit limit) {
+      if(val.size() == val.capacity()) {
+	auto [lim, max] = _lengthLimit(limit);
+	std::size_t cap = std::max<std::size_t>(2 * val.capacity(), 16);
+	if(max) {
+	  if(val.size() >= max)
+	    throw LimitError(lim, max, _count);
+	  cap = std::min(cap, max);
+	}
+	val.reserve(cap, _resource);
+      }
 
-      // Left-Trim to remove spaces after the double-semicolons
-      val.erase(val.begin(), std::find_if_not(val.begin(), val.end(), [](unsigned char c) {
-									return std::isspace(c);
-								      }));
+      val.push_back(c);
     }
 
-    // Checks if a character is a valid start to a number (is +/- or a digit)
-    bool _isValidNumStart(char c) {
-      return (c == '-' || c == '+' || _isDigit(c));
+    // Final check once a token is complete, catches limits smaller than the inline capacity of the buffer
+    void _checkLength(const SmallString &val, Limit limit) const {
+      auto [lim, max] = _lengthLimit(limit);
+      if(max && val.size() > max)
+	throw LimitError(lim, max, _count);
     }
 
-    // Will attempt to determine whether a space-delimited word is a numeric type or symbol
-    void _statefulRead() {
+    // Skips whitespace between tokens, so that canRead() only reports actual tokens
+    // The last peek also says whether there is another token, TokenRange goes by that instead of canRead()
+    void _skipSpace() {
       char c;
-      _r.peek(c);
-
-      // A flag indicating if something is escaped or not
-      Escapes escp = Escapes::NONE;
-
-      // Add to string
-      std::string &val = getTokenVal<TokenType::STRING>(*_ret.second);
-
-      // Since this is the first character, we can quickly decide the initial type
-      // Assume float
-      if(c == '.')
-	_ret.first = TokenType::FLOAT;
-      // Assume int
-      else if(_isValidNumStart(c))
-	_ret.first = TokenType::INT;
-      // Assume symbol
-      else
-	_ret.first = TokenType::SYMBOL;
-
-      // Begin the state machine to keep reading and refine the above
-      while(_r.read(c)  && (c != ' ')) {
-	// Check if it is escaped
-	if(c == '\\') {
-	  // Read one extra character
-	  if(!(_r.read(c))) throw "Cannot end symbol with unescaped backslash";
-
-	  val.push_back(c);
-	  continue;
-	}
-	else if(c == '|') {
-	  // Read until we hit another pipe
-	  while(_r.read(c) && c != '|')
-	    val.push_back(c);
+      while((_more = _r.peek(c)) && _isSpace(c))
+	_r.read(c);
+    }
 
-	  if(c != '|') throw "Unclosed pipe character found";
-	  continue;
-	}
+    bool _isSpace(char c) {return detail::isSpace(c);}
 
-	// Check if it is a reserved character
-	else if(std::find(RESERVED_SYM_CHARS.begin(), RESERVED_SYM_CHARS.end(), c) != RESERVED_SYM_CHARS.end())
-	  throw "Unescaped illegal character in symbol";
-
-	// Add character to current token
-	val.push_back(c);
-
-	// If something is a digit, no change to the state will occur
-	if(_isDigit(c)) continue;
-
-	switch(_ret.first) {
-	case TokenType::INT:
-	  switch(c) {
-	  case '/':
-	    _r.peek(c);
-	    if(!_isDigit(c))
-	      _ret.first = TokenType::SYMBOL;
-	    else
-	      _ret.first = TokenType::FRACTION;
-	    break;
-	  case '.':
-	    // Still an int, unless the next character is a digit
-	    _r.peek(c);
-	    if(_isDigit(c))
-	      _ret.first = TokenType::FLOAT;
-	    break;
-	  case 'e':
-	    // If the next character is not a sign or a number, this is a symbol
-	    _r.peek(c);
-	    if(!_isValidNumStart(c))
-	      _ret.first = TokenType::SYMBOL;
-	    else
-	      _ret.first = TokenType::FLOAT;
-	    break;
-	  case 'd':
-	    // If the next character is not a sign or a number, this is a symbol
-	    _r.peek(c);
-	    if(!_isValidNumStart(c))
-	      _ret.first = TokenType::SYMBOL;
-	    else
-	      _ret.first = TokenType::DOUBLE;
-	    break;
-	  default:		// None of these characters work, it is a symbol
-	    if(!(_isValidNumStart(c) && val.size() == 1))
-	      _ret.first = TokenType::SYMBOL;
-	    break;
-	  }
-	  break;
-	case TokenType::FRACTION:
-	  _ret.first = TokenType::SYMBOL;
-	  break;
-	case TokenType::FLOAT:
-	  if(c == 'e') {	// Ok, we found an exponential
-	    // If there was one previously, this is wrong
-	    if(std::find(val.begin(), val.end() - 1, 'e') != val.end() - 1)
-	      _ret.first = TokenType::SYMBOL;
-	    // If there is no further numeric character or (+/-), that is also wrong
-	    else if(_r.peek(c) && !_isValidNumStart(c))
-	      _ret.first = TokenType::SYMBOL;
-	    // Otherwise, we are still a float
-	  }
-	  else if(c == 'd') {	// We have a double
-	    // If there was one previously, this is wrong
-	    if(std::find(val.begin(), val.end() - 1, 'd') != val.end() - 1)
-	      _ret.first = TokenType::SYMBOL;
-	    // If there is no further numeric character or (+/-), that is also wrong
-	    else if(_r.peek(c) && !_isValidNumStart(c))
-	      _ret.first = TokenType::SYMBOL;
-	    // Otherwise, it is a double
-	    _ret.first = TokenType::DOUBLE;
-	  }
-	  // If this is a +/- with one previous character not being an 'e'
-	  else if((c == '+' || c == '-') && val[val.size() - 2] != 'e')
-	    _ret.first = TokenType::SYMBOL;
-	  // If this is a '.' with a previous e
-	  else if(c == '.' && std::find(val.begin(), val.end() - 1, 'e') != val.end() - 1)
-	    _ret.first = TokenType::SYMBOL;
-	  break;
-	case TokenType::DOUBLE:
-	  // If the previous character was a 'd', and the current one is +/-, this is fine
-	  // Otherwise, it is a symbol
-	  if(!(val.size() >= 2 && val[val.size() - 2] == 'd' && (c == '+' || c == '-')))
-	    _ret.first = TokenType::SYMBOL;
-	default:		// This is a symbol, we can just keep reading as usual here
-	  break;
-	}
-      }
+  };
+
+  template <typename T>
+  Token Tokenizer<T>::read() {
+    // Reset the token value to a symbol with empty string
+    _ret = Token{TokenType::SYMBOL, ""};
+    _begin();
+
+    char c;
+    _r.peek(c);
+    // Based on the first character we find, the rest of the characters must be parsed accordingly
+    switch(c) {
+    case token_chars::OPEN_PARENTHESIS: // Parse Open Parenthesis
+      _ret.first = TokenType::OPEN_PARENTHESIS;
+      _ret.second = std::nullopt;
+      _open();
+      // Consume the character
+      _r.read(c);
+      break;
+    case token_chars::CLOSE_PARENTHESIS: // Parse Close Parenthesis
+      _ret.first = TokenType::CLOSE_PARENTHESIS;
+      _ret.second = std::nullopt;
+      if(_depth > 0) --_depth;
+      // Consume the character
+      _r.read(c);
+      break;
+    case token_chars::STRING:	// Parse String
+      _ret.first = TokenType::STRING;
+      // Read a string into ret
+      _readStr(getTokenVal<TokenType::STRING>(*_ret.second));
+      break;
+    case token_chars::COMMENT: // Parse Comment
+      _ret.first = TokenType::COMMENT;
+      // Read a comment into ret
+      _readCmt(getTokenVal<TokenType::COMMENT>(*_ret.second));
+      break;
+    default:			// Can be either a symbol or a number here
+      _ret.first = _statefulRead(getTokenVal<TokenType::SYMBOL>(*_ret.second));
+      // Parse the read value
+      if(_ret.first != TokenType::SYMBOL)
+	detail::parseNumber(_ret.first, *_ret.second);
+      break;
+    }
+
+    _finish();
+
+    // Return the token here, moving it out keeps its text in our resource, _ret is reset on the next read
+    return std::move(_ret);
+  }
 
-      // If the last character is a + or - or e or d, it is a symbol
-      char last = val.back();
-      if(last == '+' || last == '-' || last == 'e' || last == 'd') {
-	_ret.first = TokenType::SYMBOL;
-	return;
+  template <typename T>
+  template <typename H>
+  void Tokenizer<T>::readEvent(H &handler) {
+    _begin();
+    _text.clear();
+
+    char c;
+    _r.peek(c);
+    // The same dispatch as read(), each branch calls back once the token is complete
+    switch(c) {
+    case token_chars::OPEN_PARENTHESIS:
+      _open();
+      _r.read(c);
+      _finish();
+      handler.onOpen();
+      return;
+    case token_chars::CLOSE_PARENTHESIS:
+      if(_depth > 0) --_depth;
+      _r.read(c);
+      _finish();
+      handler.onClose();
+      return;
+    case token_chars::STRING:
+      _readStr(_text);
+      _finish();
+      handler.onString(_text);
+      return;
+    case token_chars::COMMENT:
+      _readCmt(_text);
+      _finish();
+      handler.onComment(_text);
+      return;
+    default:
+      break;
+    }
+
+    TokenType type = _statefulRead(_text);
+    // Parsed before _finish(), so a number out of range does not count as read, like in read()
+    switch(type) {
+    case TokenType::INT:
+      {
+	int v = detail::parseInt(_text.c_str());
+	_finish();
+	handler.onInt(v);
       }
-      // Parse the read value and check
-      switch(_ret.first) {
-      case TokenType::SYMBOL:
-	{
-	  // Check if it is a valid symbol
-	  std::size_t dotCnt = 0;
-	  for(char c : val)
-	    dotCnt += (c == '.');
-	  if(dotCnt == val.size())
-	    throw "Too many dots";
-	}
-	break;
-      case TokenType::INT:
-	_ret.second = std::stoi(val);
-	break;
-      case TokenType::FLOAT:
-	_ret.second = std::stof(val);
-	break;
-      case TokenType::DOUBLE:
-	_ret.second = std::stod(val.replace(val.find('d'), 1, "e"));
-	break;
-      case TokenType::FRACTION:
-	{
-	  // Split into substrings, parse each as an int
-	  int divLoc = val.find('/');
-	  std::string_view lhs(&val[0], divLoc);
-	  std::string_view rhs(&val[divLoc + 1], val.size() - (divLoc + 1));
-
-	  // Now, convert both to int's and create a fraction
-	  int num = std::stoi(lhs.data());
-	  int den = std::stoi(rhs.data());
-	  Fraction f(num, den);
-	  if(f.isInt()) {
-	    _ret.first = TokenType::INT;
-	    _ret.second = f.getNum();
-	  }
-	  else
-	    _ret.second = f;
-	}
-	break;
+      break;
+    case TokenType::FLOAT:
+      {
+	float v = detail::parseFloat(_text.c_str());
+	_finish();
+	handler.onFloat(v);
       }
+      break;
+    case TokenType::DOUBLE:
+      {
+	_text[_text.find('d')] = 'e';
+	double v = detail::parseDouble(_text.c_str());
+	_finish();
+	handler.onDouble(v);
+      }
+      break;
+    case TokenType::FRACTION:
+      {
+	Fraction f = detail::parseFraction(_text.c_str());
+	_finish();
+	if(f.isInt())
+	  handler.onInt(f.getNum());
+	else
+	  handler.onFraction(f);
+      }
+      break;
+    default:
+      _finish();
+      handler.onSymbol(_text);
+      break;
     }
+  }
+
+  template <typename T>
+  void Tokenizer<T>::_readStr(SmallString &val) {
+    char c;
+    _r.read(c);
+    if(c != token_chars::STRING)
+      throw "Missing double-quotes at start of string literal";
+
+    // Consume characters until we hit a "
+    bool closed = false;
+    while(_r.read(c) && !(closed = (c == token_chars::STRING)))
+      _push(val, c, Limit::STRING_LENGTH);
+    if(!closed)
+      throw "Missing closing double-quotes for string literal";
+    _checkLength(val, Limit::STRING_LENGTH);
+  }
+
+  template <typename T>
+  void Tokenizer<T>::_readCmt(SmallString &val) {
+    // Read until we stop finding ';'
+    char c;
+    _r.read(c);
+
+    // If the first character is not a comment character, throw an error
+    if(c != token_chars::COMMENT)
+      throw "Missing semicolon at start of comment";
+
+    // Keep reading characters until we hit a non-COMMENT one or EOF
+    while(_r.peek(c) && c == token_chars::COMMENT) _r.read(c);
+
+    // Start reading the actual comment
+    while(_r.read(c) && c != '\n') _push(val, c, Limit::TOKEN_LENGTH);
+    _checkLength(val, Limit::TOKEN_LENGTH);
+
+    // Left-Trim to remove spaces after the double-semicolons
+    val.erase(val.begin(), std::find_if_not(val.begin(), val.end(), [](unsigned char c) {
+								      return std::isspace(c);
+								    }));
+  }
+
+  template <typename T>
+  TokenType Tokenizer<T>::_statefulRead(SmallString &val) {
+    char c;
+    // The atom DFA sees every character, the ones that stop it lead to a state past the scanning ones saying
+    // what to do with them, so where atoms end and what escapes them comes from the grammar
+    std::uint8_t state = dfa::START;
+    bool escaped = false;	// Something was escaped, this can only be a symbol
+
+    while(_r.peek(c)) {
+      std::uint8_t next = dfa::transitions[state][dfa::classes[static_cast<unsigned char>(c)]];
+      if(next < dfa::SCANNING) {
+	_r.read(c);
+	_push(val, c, Limit::TOKEN_LENGTH);
+	state = next;
+	continue;
+      }
+
+      if(next == dfa::END_ATOM) break;
+      _r.read(c);
+      if(next == dfa::ILLEGAL) throw "Unescaped illegal character in symbol";
 
-    bool _isDigit(char c) {
-      return c >= 48 && c <= 57;
+      // Escapes leave the state alone, what the atom is does not depend on it any more
+      if(dfa::classes[static_cast<unsigned char>(c)] == dfa::BACKSLASH) {
+	// Read one extra character
+	if(!(_r.read(c))) throw "Cannot end symbol with unescaped backslash";
+
+	_push(val, c, Limit::TOKEN_LENGTH);
+      }
+      else {
+	// Read until we hit another pipe, or whatever else the grammar quotes with
+	// c still holds the opening one when the input ends right after it, so track whether it was closed
+	char quote = c;
+	bool closed = false;
+	while(_r.read(c) && !(closed = (c == quote)))
+	  _push(val, c, Limit::TOKEN_LENGTH);
+
+	if(!closed) throw "Unclosed pipe character found";
+      }
+      escaped = true;
     }
-  };
+
+    _checkLength(val, Limit::TOKEN_LENGTH);
+
+    // Escaped atoms are symbols, even empty ones (||), only unescaped ones may consist entirely of dots
+    TokenType type = escaped ? TokenType::SYMBOL : dfa::accepts[state];
+    if(type == TokenType::END)
+      throw "Too many dots";
+
+    return type;
+  }
 
   // Useful typedefs
   typedef Tokenizer<StringReader> StringTokenizer;
   typedef Tokenizer<StreamReader> StreamTokenizer;
+
+#ifndef LISP_READER_HEADER_ONLY
+  // Instantiated once in the library rather than in every translation unit that reads tokens
+  extern template class Tokenizer<StringReader>;
+  extern template class Tokenizer<StreamReader>;
+#endif
 };				// lisp_reader
 
 #endif // CPPLISPREADER_READER_HPP
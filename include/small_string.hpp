@@ -0,0 +1,207 @@
+#ifndef CPPLISPREADER_SMALL_STRING_HPP
+#define CPPLISPREADER_SMALL_STRING_HPP
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+
+namespace lisp_reader {
+  // The string type of token payloads, holding up to 23 characters in place before it allocates
+  // It is 24 bytes, all of them characters when inline. The last byte holds how many more characters fit
+  // inline, which doubles as the terminating NUL of a full inline string, or HEAP once the characters moved
+  // to the heap, in which case the buffer holds a pointer, the size and a 56-bit capacity instead
+  // Nothing points back into the object, so moving one is copying its bytes, unlike std::string
+  // Text is always NUL terminated
+  // Heap buffers come from a std::pmr::memory_resource, the default one unless another is passed to the
+  // constructor or reserve(). Each buffer records its resource, which it goes back to and which later growth
+  // keeps using. Copies use the default resource, like the std::pmr containers
+  class SmallString {
+  public:
+    static constexpr std::size_t INLINE_CAPACITY = 23;
+    static constexpr std::size_t npos = std::string_view::npos;
+
+    SmallString() {_setInlineSize(0);}
+    SmallString(std::string_view str) {_init(str.data(), str.size());}
+    SmallString(const char *str) {_init(str, std::strlen(str));}
+    SmallString(const std::string &str) {_init(str.data(), str.size());}
+    SmallString(std::string_view str, std::pmr::memory_resource *resource) {
+      _setInlineSize(0);
+      reserve(str.size(), resource);
+      assign(str.data(), str.size());
+    }
+    SmallString(const SmallString &other) {_init(other.data(), other.size());}
+    SmallString(SmallString &&other) noexcept {
+      std::memcpy(_buf, other._buf, sizeof(_buf));
+      other._setInlineSize(0);
+    }
+    SmallString &operator=(const SmallString &other) {
+      if(this != &other) assign(other.data(), other.size());
+      return *this;
+    }
+    SmallString &operator=(SmallString &&other) noexcept {
+      if(this != &other) {
+	_free();
+	std::memcpy(_buf, other._buf, sizeof(_buf));
+	other._setInlineSize(0);
+      }
+      return *this;
+    }
+    ~SmallString() {_free();}
+
+    bool isInline() const {return _tagByte() != HEAP;}
+    std::size_t size() const {return isInline() ? INLINE_CAPACITY - _tagByte() : _get(SIZE_AT);}
+    std::size_t capacity() const {return isInline() ? INLINE_CAPACITY : _heapCapacity();}
+    bool empty() const {return size() == 0;}
+
+    char *data() {return isInline() ? _buf : reinterpret_cast<char *>(_get(PTR_AT));}
+    const char *data() const {return isInline() ? _buf : reinterpret_cast<const char *>(_get(PTR_AT));}
+    const char *c_str() const {return data();}
+
+    char *begin() {return data();}
+    char *end() {return data() + size();}
+    const char *begin() const {return data();}
+    const char *end() const {return data() + size();}
+    char &operator[](std::size_t i) {return data()[i];}
+    char operator[](std::size_t i) const {return data()[i];}
+    char back() const {return data()[size() - 1];}
+
+    operator std::string_view() const {return {data(), size()};}
+    std::string str() const {return std::string(data(), size());}
+    std::size_t find(char c, std::size_t pos = 0) const {return std::string_view(*this).find(c, pos);}
+
+    // The resource the heap buffer came from, nullptr when inline
+    std::pmr::memory_resource *resource() const {
+      if(isInline()) return nullptr;
+
+      std::pmr::memory_resource *res;
+      std::memcpy(&res, data() - HEADER, sizeof(res));
+      return res;
+    }
+
+    // Makes room for at least cap characters, never shrinks
+    // A new buffer comes from resource if given, otherwise from the current buffer's resource or the default one
+    void reserve(std::size_t cap, std::pmr::memory_resource *resource = nullptr) {
+      if(cap <= capacity()) return;
+
+      if(!resource) resource = isInline() ? std::pmr::get_default_resource() : this->resource();
+      std::size_t len = size();
+      // The resource is stored in front of the characters
+      char *block = static_cast<char *>(resource->allocate(HEADER + cap + 1, alignof(std::pmr::memory_resource *)));
+      std::memcpy(block, &resource, sizeof(resource));
+      std::memcpy(block + HEADER, data(), len + 1);
+      _free();
+      _setHeap(block + HEADER, len, cap);
+    }
+
+    void push_back(char c) {
+      std::size_t len = size();
+      if(len == capacity()) reserve(2 * len);
+
+      char *p = data();
+      p[len] = c;
+      p[len + 1] = '\0';
+      _setSize(len + 1);
+    }
+
+    void clear() {
+      *data() = '\0';
+      _setSize(0);
+    }
+
+    void assign(const char *str, std::size_t len) {
+      if(len > capacity()) {
+	std::pmr::memory_resource *res = resource();
+	_free();
+	_setInlineSize(0);
+	reserve(len, res);
+      }
+      std::memmove(data(), str, len);
+      data()[len] = '\0';
+      _setSize(len);
+    }
+
+    // Removes [first, last), returning where the characters after them now start
+    char *erase(char *first, char *last) {
+      std::size_t len = size();
+      std::memmove(first, last, end() - last + 1);
+      _setSize(len - (last - first));
+      return first;
+    }
+
+    bool operator==(const SmallString &rhs) const {return std::string_view(*this) == std::string_view(rhs);}
+    bool operator!=(const SmallString &rhs) const {return !(*this == rhs);}
+    bool operator<(const SmallString &rhs) const {return std::string_view(*this) < std::string_view(rhs);}
+  private:
+    static constexpr unsigned char HEAP = 0xff;
+    static constexpr std::size_t HEADER = sizeof(std::pmr::memory_resource *);
+    static constexpr std::size_t PTR_AT = 0;
+    static constexpr std::size_t SIZE_AT = sizeof(std::size_t);
+    static constexpr std::size_t CAP_AT = 2 * sizeof(std::size_t);
+
+    char _buf[INLINE_CAPACITY + 1];
+    static_assert(3 * sizeof(std::size_t) == INLINE_CAPACITY + 1, "The heap fields must fill the inline buffer");
+
+    unsigned char _tagByte() const {return static_cast<unsigned char>(_buf[INLINE_CAPACITY]);}
+
+    std::size_t _get(std::size_t at) const {
+      std::size_t v;
+      std::memcpy(&v, _buf + at, sizeof(v));
+      return v;
+    }
+    void _put(std::size_t at, std::size_t v) {std::memcpy(_buf + at, &v, sizeof(v));}
+
+    // The capacity takes the 7 bytes before the tag
+    std::size_t _heapCapacity() const {
+      std::size_t cap = 0;
+      for(std::size_t i = 0; i < 7; ++i)
+	cap |= static_cast<std::size_t>(static_cast<unsigned char>(_buf[CAP_AT + i])) << (8 * i);
+      return cap;
+    }
+    void _setHeap(char *p, std::size_t len, std::size_t cap) {
+      _put(PTR_AT, reinterpret_cast<std::size_t>(p));
+      _put(SIZE_AT, len);
+      for(std::size_t i = 0; i < 7; ++i)
+	_buf[CAP_AT + i] = static_cast<char>(cap >> (8 * i));
+      _buf[INLINE_CAPACITY] = static_cast<char>(HEAP);
+    }
+
+    void _setInlineSize(std::size_t len) {
+      _buf[len] = '\0';
+      _buf[INLINE_CAPACITY] = static_cast<char>(INLINE_CAPACITY - len);
+    }
+    void _setSize(std::size_t len) {
+      if(isInline()) _setInlineSize(len);
+      else _put(SIZE_AT, len);
+    }
+
+    void _init(const char *str, std::size_t len) {
+      _setInlineSize(0);
+      assign(str, len);
+    }
+
+    void _free() {
+      if(!isInline())
+	resource()->deallocate(data() - HEADER, HEADER + _heapCapacity() + 1, alignof(std::pmr::memory_resource *));
+    }
+  };
+  static_assert(sizeof(SmallString) == 24, "SmallString must stay three words");
+
+  inline std::ostream &operator<<(std::ostream &os, const SmallString &str) {
+    return os << std::string_view(str);
+  }
+};				// lisp_reader
+
+namespace std {
+  template <>
+  struct hash<lisp_reader::SmallString> {
+    size_t operator()(const lisp_reader::SmallString &str) const {
+      return hash<string_view>()(str);
+    }
+  };
+} // std
+
+#endif // CPPLISPREADER_SMALL_STRING_HPP
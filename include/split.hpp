@@ -0,0 +1,114 @@
+#ifndef CPPLISPREADER_SPLIT_HPP
+#define CPPLISPREADER_SPLIT_HPP
+
+#include "reader.hpp"
+
+#include <algorithm>
+#include <string_view>
+#include <vector>
+
+namespace lisp_reader {
+  // A place where the input can be cut and tokenized independently from both sides
+  // depth is the nesting depth of parenthesis at that point, for readers that want to keep track of it
+  struct SplitPoint {
+    std::size_t offset;
+    std::size_t depth;
+  };
+
+  namespace detail {
+    // Walks str from the safe point from, calling f(point) at every safe point after it until f returns true
+    // A point is only safe at whitespace outside of strings, comments and |escaped| sections, with no pending
+    // backslash escape, since the Tokenizer starting there must see the same tokens it would have from the start
+    // Whitespace and escapes are the grammar's, see dfa::escapesNext() and dfa::quotes()
+    // Returns the point f stopped at, or the end of the input, which is safe too
+    template <typename F>
+    SplitPoint walkSafePoints(std::string_view str, SplitPoint from, F f) {
+      std::size_t depth = from.depth;
+      for(std::size_t i = from.offset; i < str.size(); ++i) {
+	char c = str[i];
+	switch(c) {
+	case token_chars::OPEN_PARENTHESIS:
+	  ++depth;
+	  break;
+	case token_chars::CLOSE_PARENTHESIS:
+	  if(depth > 0) --depth;
+	  break;
+	case token_chars::STRING:	// Strings end at the next double-quote, there are no escapes inside them
+	  while(++i < str.size() && str[i] != token_chars::STRING);
+	  break;
+	case token_chars::COMMENT:
+	  while(++i < str.size() && str[i] != '\n');
+	  break;
+	default:
+	  if(dfa::classes[static_cast<unsigned char>(c)] == dfa::SPACE) {
+	    if(f(SplitPoint{i, depth})) return SplitPoint{i, depth};
+	  }
+	  else if(dfa::escapesNext(c))
+	    ++i;
+	  else if(dfa::quotes(c))
+	    while(++i < str.size() && str[i] != c);
+	  break;
+	}
+      }
+
+      return SplitPoint{str.size(), depth};
+    }
+  } // detail
+
+  // Finds points to cut str into chunks of roughly chunkSize characters each, see detail::walkSafePoints
+  // The first point is always offset 0, the end of the input is not included
+  // This is a single cheap pass compared to tokenizing, but it is still serial over the whole input
+  inline std::vector<SplitPoint> findSplitPoints(std::string_view str, std::size_t chunkSize) {
+    std::vector<SplitPoint> points{{0, 0}};
+    if(!chunkSize) return points;
+
+    std::size_t target = chunkSize;
+    detail::walkSafePoints(str, points[0], [&](SplitPoint p) {
+					     if(p.offset >= target) {
+					       points.push_back(p);
+					       target = p.offset + chunkSize;
+					     }
+					     return false;
+					   });
+
+    return points;
+  }
+
+  // The first safe point at or after offset, walking forward from a known one, like a previous split point, a
+  // Tokenizer checkpoint or the start of the input. Exact, but linear in the distance walked
+  inline SplitPoint nextSafePoint(std::string_view str, SplitPoint from, std::size_t offset) {
+    if(from.offset >= offset) return from;
+    return detail::walkSafePoints(str, from, [&](SplitPoint p) {return p.offset >= offset;});
+  }
+
+  // The same, walking from the closest of known safe points at or before offset, sorted by offset, like the
+  // points of findSplitPoints() or Tokenizer checkpoints taken along the way. Exact, and only linear in the
+  // distance from that point, so an index of points every few KB makes seeking anywhere cheap
+  inline SplitPoint nextSafePoint(std::string_view str, const std::vector<SplitPoint> &known, std::size_t offset) {
+    auto after = std::upper_bound(known.begin(), known.end(), offset,
+				  [](std::size_t off, const SplitPoint &p) {return off < p.offset;});
+    if(after == known.begin()) return nextSafePoint(str, SplitPoint{0, 0}, offset);
+    return nextSafePoint(str, *(after - 1), offset);
+  }
+
+  // A guess at a safe point at or after an arbitrary offset, without walking from a known one, which can be wrong
+  // Goes back to the closest open parenthesis in the first column before offset, which starts a top-level form
+  // by Lisp convention (Emacs' beginning-of-defun assumes the same), then walks forward from there at depth 0
+  // Comments end at newlines so they cannot hide such a parenthesis, but a string or |escaped| section spanning
+  // lines can, and then the point returned is inside it and nothing detects it. Only for things like
+  // positioning an editor: nothing in the library tokenizes from it, and neither should anything that needs
+  // the right tokens, use nextSafePoint() for that. Without such a parenthesis it walks from the start
+  inline SplitPoint guessSafePoint(std::string_view str, std::size_t offset) {
+    offset = std::min(offset, str.size());
+    std::size_t anchor = 0;
+    for(std::size_t i = offset; i > 1; --i)
+      if(str[i - 1] == token_chars::OPEN_PARENTHESIS && str[i - 2] == '\n') {
+	anchor = i - 1;
+	break;
+      }
+
+    return nextSafePoint(str, SplitPoint{anchor, 0}, offset);
+  }
+};				// lisp_reader
+
+#endif // CPPLISPREADER_SPLIT_HPP
@@ -0,0 +1,75 @@
+#ifndef CPPLISPREADER_SPSC_RING_HPP
+#define CPPLISPREADER_SPSC_RING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace lisp_reader {
+  // Size of a cache line, what the two ends of a ring are kept apart by
+  inline constexpr std::size_t CACHE_LINE = 64;
+
+  // A bounded, lock-free ring between exactly one producer thread and one consumer thread
+  // Slots are filled and drained in place: the producer writes into back() and publishes it with push(), the
+  // consumer reads front() and hands it back with pop(), so slots keep whatever they allocated for reuse
+  // Each end keeps its index and its last look at the other end's on a cache line of its own, and only reloads
+  // the other index when the ring looks full (or empty), so in steady state the ends hardly share a line at all
+  template <typename T>
+  class SpscRing {
+  public:
+    // Rounded up to a power of two
+    explicit SpscRing(std::size_t capacity) : _slots(_roundUp(capacity)), _mask(_slots.size() - 1) {}
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    std::size_t capacity() const {return _slots.size();}
+
+    // Producer: the slot to fill next, nullptr while the ring is full
+    T *back() {
+      std::size_t tail = _producer.index.load(std::memory_order_relaxed);
+      if(tail - _producer.seen == _slots.size()) {
+	_producer.seen = _consumer.index.load(std::memory_order_acquire);
+	if(tail - _producer.seen == _slots.size()) return nullptr;
+      }
+      return &_slots[tail & _mask];
+    }
+    // Producer: hands the slot from back() to the consumer, only once back() returned one
+    void push() {
+      _producer.index.store(_producer.index.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Consumer: the oldest slot pushed, nullptr while the ring is empty
+    T *front() {
+      std::size_t head = _consumer.index.load(std::memory_order_relaxed);
+      if(head == _consumer.seen) {
+	_consumer.seen = _producer.index.load(std::memory_order_acquire);
+	if(head == _consumer.seen) return nullptr;
+      }
+      return &_slots[head & _mask];
+    }
+    // Consumer: gives the slot from front() back to the producer, only once front() returned one
+    void pop() {
+      _consumer.index.store(_consumer.index.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+  private:
+    // One end of the ring, written only by its own thread
+    struct alignas(CACHE_LINE) End {
+      std::atomic<std::size_t> index{0};
+      // The other end's index as last loaded
+      std::size_t seen = 0;
+    };
+
+    std::vector<T> _slots;
+    std::size_t _mask;
+    End _producer;
+    End _consumer;
+
+    static std::size_t _roundUp(std::size_t n) {
+      std::size_t ret = 1;
+      while(ret < n) ret <<= 1;
+      return ret;
+    }
+  };
+};				// lisp_reader
+
+#endif // CPPLISPREADER_SPSC_RING_HPP
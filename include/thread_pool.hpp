@@ -0,0 +1,133 @@
+#ifndef CPPLISPREADER_THREAD_POOL_HPP
+#define CPPLISPREADER_THREAD_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lisp_reader {
+  // A fixed-size thread pool where every worker owns a deque of tasks
+  // Workers take their own newest task first and steal the oldest task of another worker once theirs runs dry,
+  // so a worker stuck on a large task never leaves the others idle while its queue still holds work
+  // Tasks may submit further tasks, they land on the deque of the worker running them
+  class WorkStealingPool {
+  public:
+    typedef std::function<void()> Task;
+
+    explicit WorkStealingPool(std::size_t threads = std::thread::hardware_concurrency())
+      : _queues(std::max<std::size_t>(threads, 1)), _next(0), _queued(0), _unfinished(0), _stop(false) {
+      for(std::size_t i = 0; i < _queues.size(); ++i)
+	_threads.emplace_back([this, i]() {_work(i);});
+    }
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+    ~WorkStealingPool() {
+      wait();
+      {
+	std::lock_guard<std::mutex> lock(_m);
+	_stop = true;
+      }
+      _wake.notify_all();
+      for(std::thread &t : _threads) t.join();
+    }
+
+    std::size_t size() const {return _queues.size();}
+
+    // Queues a task, tasks must not throw
+    void submit(Task task) {
+      // Tasks spawned by a worker stay on its deque, others are dealt out in turn
+      std::size_t q = _currentPool == this ? _currentIndex : _next++ % _queues.size();
+      _unfinished.fetch_add(1);
+      {
+	std::lock_guard<std::mutex> lock(_queues[q].m);
+	_queues[q].tasks.push_back(std::move(task));
+      }
+      {
+	std::lock_guard<std::mutex> lock(_m);
+	++_queued;
+      }
+      _wake.notify_one();
+    }
+
+    // Blocks until every submitted task, including the ones they submitted, has finished
+    void wait() {
+      std::unique_lock<std::mutex> lock(_m);
+      _done.wait(lock, [this]() {return _unfinished.load() == 0;});
+    }
+  private:
+    struct Queue {
+      std::mutex m;
+      std::deque<Task> tasks;
+    };
+    // Identifies the worker running on the current thread, if any
+    static inline thread_local const WorkStealingPool *_currentPool = nullptr;
+    static inline thread_local std::size_t _currentIndex = 0;
+
+    std::vector<Queue> _queues;
+    std::vector<std::thread> _threads;
+    std::atomic<std::size_t> _next;
+
+    // Guards _queued and _stop, and is what idle workers and wait() sleep on
+    std::mutex _m;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    std::size_t _queued;
+    std::atomic<std::size_t> _unfinished;
+    bool _stop;
+
+    // Takes a task from the back of our own deque, or the front of someone else's
+    bool _take(std::size_t self, Task &task) {
+      for(std::size_t i = 0; i < _queues.size(); ++i) {
+	Queue &q = _queues[(self + i) % _queues.size()];
+	std::lock_guard<std::mutex> lock(q.m);
+	if(q.tasks.empty()) continue;
+
+	if(i == 0) {
+	  task = std::move(q.tasks.back());
+	  q.tasks.pop_back();
+	}
+	else {
+	  task = std::move(q.tasks.front());
+	  q.tasks.pop_front();
+	}
+	return true;
+      }
+
+      return false;
+    }
+
+    void _work(std::size_t self) {
+      _currentPool = this;
+      _currentIndex = self;
+
+      for(;;) {
+	{
+	  // Sleep until there is something queued anywhere
+	  std::unique_lock<std::mutex> lock(_m);
+	  _wake.wait(lock, [this]() {return _stop || _queued > 0;});
+	  if(_stop) return;
+	  --_queued;
+	}
+
+	// A task is reserved for us through _queued, so this always finds one
+	Task task;
+	while(!_take(self, task)) std::this_thread::yield();
+	task();
+
+	if(_unfinished.fetch_sub(1) == 1) {
+	  std::lock_guard<std::mutex> lock(_m);
+	  _done.notify_all();
+	}
+      }
+    }
+  };
+};				// lisp_reader
+
+#endif // CPPLISPREADER_THREAD_POOL_HPP
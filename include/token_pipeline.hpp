@@ -0,0 +1,117 @@
+#ifndef CPPLISPREADER_TOKEN_PIPELINE_HPP
+#define CPPLISPREADER_TOKEN_PIPELINE_HPP
+
+#include "reader.hpp"
+#include "spsc_ring.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace lisp_reader {
+  // How a TokenPipeline hands tokens over
+  struct PipelineOptions {
+    std::size_t batchSize = 512;	// Tokens per batch, each batch costs one hand-over between the threads
+    std::size_t depth = 8;		// Batches in flight, the lexer waits once it is this far ahead
+  };
+
+  // Runs a Tokenizer on a thread of its own, handing its tokens over to the thread reading them in batches
+  // through an SpscRing, so lexing and whatever consumes the tokens, like a TreeBuilder, overlap on two cores
+  // It reads like a Tokenizer, with canRead(), read() and count(), but only from one thread at a time
+  // Errors reach the reader right after the tokens read before them, as if it was lexing itself
+  // Tokens are built on the lexer's thread and freed on the reader's, so the tokenizer's memory resource
+  // must be thread-safe, which the default one is
+  template <typename T>
+  class TokenPipeline {
+  public:
+    explicit TokenPipeline(Tokenizer<T> &&tok, PipelineOptions opts = {})
+      : _tok(std::move(tok)), _ring(std::max<std::size_t>(opts.depth, 1)),
+	_batchSize(std::max<std::size_t>(opts.batchSize, 1)), _stop(false), _cur(nullptr), _pos(0), _count(0) {
+      _thread = std::thread([this]() {_produce();});
+    }
+    TokenPipeline(const TokenPipeline &) = delete;
+    TokenPipeline &operator=(const TokenPipeline &) = delete;
+    // Stops the lexer, even if its tokens were not all read
+    ~TokenPipeline() {
+      _stop.store(true, std::memory_order_relaxed);
+      _thread.join();
+    }
+
+    // Waits for the next batch when the current one is done with
+    bool canRead() {
+      for(;;) {
+	if(_cur) {
+	  if(_pos < _cur->tokens.size()) return true;
+	  if(_cur->last) {
+	    if(_cur->err) std::rethrow_exception(_cur->err);
+	    return false;
+	  }
+	  _cur->tokens.clear();
+	  _ring.pop();
+	  _cur = nullptr;
+	  _pos = 0;
+	}
+	for(unsigned spins = 0; !(_cur = _ring.front()); ) _backOff(spins);
+      }
+    }
+
+    // NOTE: Undefined behavior if read without checking canRead() first
+    Token read() {
+      ++_count;
+      return std::move(_cur->tokens[_pos++]);
+    }
+
+    // Number of tokens read so far, on the reading side
+    std::size_t count() const {return _count;}
+  private:
+    struct Batch {
+      std::vector<Token> tokens;
+      // Set on the last batch, with the error that ended lexing if any
+      bool last = false;
+      std::exception_ptr err;
+    };
+
+    // Only touched by the lexer's thread once it runs
+    Tokenizer<T> _tok;
+    SpscRing<Batch> _ring;
+    std::size_t _batchSize;
+    std::atomic<bool> _stop;
+    std::thread _thread;
+
+    // The reading side
+    Batch *_cur;
+    std::size_t _pos;
+    std::size_t _count;
+
+    // Spins briefly, then yields the core to the other thread, which may well be waiting for it
+    static void _backOff(unsigned &spins) {
+      if(++spins > 64) std::this_thread::yield();
+    }
+
+    // Runs on the lexer's thread, filling batches until the input runs out or fails
+    void _produce() {
+      for(;;) {
+	Batch *b;
+	for(unsigned spins = 0; !(b = _ring.back()); _backOff(spins))
+	  if(_stop.load(std::memory_order_relaxed)) return;
+
+	b->tokens.reserve(_batchSize);
+	try {
+	  while(b->tokens.size() < _batchSize && _tok.canRead()) b->tokens.push_back(_tok.read());
+	  b->last = !_tok.canRead();
+	}
+	catch(...) {
+	  b->err = std::current_exception();
+	  b->last = true;
+	}
+	_ring.push();
+	if(b->last) return;
+      }
+    }
+  };
+};				// lisp_reader
+
+#endif // CPPLISPREADER_TOKEN_PIPELINE_HPP
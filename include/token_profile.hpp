@@ -0,0 +1,98 @@
+#ifndef CPPLISPREADER_TOKEN_PROFILE_HPP
+#define CPPLISPREADER_TOKEN_PROFILE_HPP
+
+#include "reader.hpp"
+#include "perf_counters.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+namespace lisp_reader {
+  // Hardware counter totals of the reads that produced each TokenType, see ProfiledTokenizer
+  struct TokenProfile {
+    struct Entry {
+      std::size_t tokens = 0;
+      // Input consumed by those reads, the token and the whitespace after it
+      std::size_t bytes = 0;
+      PerfSample counts;
+    };
+    std::array<Entry, static_cast<int>(TokenType::END)> types;
+
+    const Entry &operator[](TokenType t) const {return types[static_cast<int>(t)];}
+
+    double cyclesPerByte(TokenType t) const {
+      return _ratio((*this)[t].counts[PerfCounter::CYCLES], (*this)[t].bytes);
+    }
+    double branchMissesPerToken(TokenType t) const {
+      return _ratio((*this)[t].counts[PerfCounter::BRANCH_MISSES], (*this)[t].tokens);
+    }
+    double l1dMissesPerByte(TokenType t) const {
+      return _ratio((*this)[t].counts[PerfCounter::L1D_MISSES], (*this)[t].bytes);
+    }
+    // Instructions per cycle
+    double ipc(TokenType t) const {
+      return _ratio((*this)[t].counts[PerfCounter::INSTRUCTIONS], (*this)[t].counts[PerfCounter::CYCLES]);
+    }
+  private:
+    static double _ratio(double num, double den) {return den ? num / den : 0;}
+  };
+
+  // Opt-in instrumentation: wraps a Tokenizer and attributes the counters of every read() to the type of the
+  // token it returned, so the cost of each path through the state machine can be told apart
+  // The counters are read around each token, and what reading them costs on its own is measured up front and
+  // taken off again. That is a syscall per token, so only the counts mean anything here, time the plain
+  // Tokenizer instead. Without counters (see PerfCounters) only tokens and bytes are tallied
+  template <typename T>
+  class ProfiledTokenizer {
+  public:
+    explicit ProfiledTokenizer(Tokenizer<T> &tok) : _tok(tok) {
+      _counters.start();
+      _calibrate();
+    }
+    ~ProfiledTokenizer() {_counters.stop();}
+
+    bool canRead() const {return _tok.canRead();}
+
+    Token read() {
+      std::size_t begin = _tok.offset();
+      PerfSample before = _counters.read();
+      Token ret = _tok.read();
+      PerfSample after = _counters.read();
+
+      TokenProfile::Entry &e = _profile.types[static_cast<int>(ret.first)];
+      ++e.tokens;
+      e.bytes += _tok.offset() - begin;
+      for(std::size_t i = 0; i < e.counts.values.size(); ++i) {
+	std::uint64_t d = after.values[i] - before.values[i];
+	e.counts.values[i] += d > _overhead.values[i] ? d - _overhead.values[i] : 0;
+      }
+
+      return ret;
+    }
+
+    const TokenProfile &profile() const {return _profile;}
+    const PerfCounters &counters() const {return _counters;}
+  private:
+    Tokenizer<T> &_tok;
+    PerfCounters _counters;
+    TokenProfile _profile;
+    // What a pair of counter reads costs with nothing in between
+    PerfSample _overhead;
+
+    // The smallest of a few back to back pairs, anything above that is noise we cannot attribute anyway
+    void _calibrate() {
+      if(!_counters.available()) return;
+
+      _overhead.values.fill(UINT64_MAX);
+      for(int i = 0; i < 64; ++i) {
+	PerfSample d = _counters.read();
+	d = _counters.read() - d;
+	for(std::size_t j = 0; j < d.values.size(); ++j)
+	  _overhead.values[j] = std::min(_overhead.values[j], d.values[j]);
+      }
+    }
+  };
+};				// lisp_reader
+
+#endif // CPPLISPREADER_TOKEN_PROFILE_HPP
@@ -0,0 +1,108 @@
+#ifndef CPPLISPREADER_TOKEN_RANGE_HPP
+#define CPPLISPREADER_TOKEN_RANGE_HPP
+
+#include "reader.hpp"
+
+#include <cstddef>
+#include <iterator>
+#include <memory_resource>
+#include <string_view>
+#include <utility>
+
+#if __has_include(<version>)
+#include <version>
+#endif
+#ifdef __cpp_lib_ranges
+#include <ranges>
+#endif
+
+namespace lisp_reader {
+  // Marks the end of a TokenRange, which is only known once the input runs out
+  struct TokenSentinel {};
+
+  // A lazy, single-pass range over the tokens of a Tokenizer it owns, see tokens()
+  // Each step reads one token, and whether there is another comes from the whitespace skipped after it,
+  // so unlike a canRead() and read() loop the reader is not peeked at twice per token
+  // Iterators hand out the current token by reference, it may be moved from and is replaced on the next step.
+  // Errors are thrown from begin() and ++ like from read()
+  // With C++20 ranges it is a view, and composes with std::views::filter, transform and the like
+  template <typename T>
+  class TokenRange
+#ifdef __cpp_lib_ranges
+    : public std::ranges::view_interface<TokenRange<T>>
+#endif
+  {
+  public:
+    class iterator {
+    public:
+      using iterator_category = std::input_iterator_tag;
+      using iterator_concept = std::input_iterator_tag;
+      using value_type = Token;
+      using difference_type = std::ptrdiff_t;
+      using pointer = Token *;
+      using reference = Token &;
+
+      iterator() : _range(nullptr) {}
+      explicit iterator(TokenRange *range) : _range(range) {}
+
+      Token &operator*() const {return _range->_token;}
+      Token *operator->() const {return &_range->_token;}
+
+      iterator &operator++() {
+	_range->_next();
+	return *this;
+      }
+      void operator++(int) {++*this;}
+
+      friend bool operator==(const iterator &it, TokenSentinel) {return it._atEnd();}
+      friend bool operator==(TokenSentinel s, const iterator &it) {return it == s;}
+      friend bool operator!=(const iterator &it, TokenSentinel s) {return !(it == s);}
+      friend bool operator!=(TokenSentinel s, const iterator &it) {return !(it == s);}
+    private:
+      TokenRange *_range;
+
+      bool _atEnd() const {return _range->_done;}
+    };
+
+    explicit TokenRange(Tokenizer<T> &&tok) : _tok(std::move(tok)), _done(false) {}
+
+    // Reads the first token, so only call it once
+    iterator begin() {
+      _next();
+      return iterator(this);
+    }
+    TokenSentinel end() const {return {};}
+
+    // The tokenizer, for its depth(), count() and span() along the way
+    const Tokenizer<T> &tokenizer() const {return _tok;}
+  private:
+    Tokenizer<T> _tok;
+    Token _token;
+    bool _done;
+
+    void _next() {
+      if(!_tok._more) {
+	_done = true;
+	return;
+      }
+      _token = _tok.read();
+    }
+  };
+
+  // Ranges over the tokens of a tokenizer, of a string or of a stream
+  // Strings are not copied, they must outlive the range
+  template <typename T>
+  TokenRange<T> tokens(Tokenizer<T> &&tok) {
+    return TokenRange<T>(std::move(tok));
+  }
+  inline TokenRange<StringReader> tokens(std::string_view str, ReaderLimits limits = {},
+					 std::pmr::memory_resource *resource = std::pmr::get_default_resource()) {
+    return TokenRange<StringReader>(StringTokenizer(StringReader(str), limits, resource));
+  }
+  inline TokenRange<StreamReader> tokens(std::istream &is, ReaderLimits limits = {},
+					 std::pmr::memory_resource *resource = std::pmr::get_default_resource()) {
+    return TokenRange<StreamReader>(StreamTokenizer(StreamReader(is), limits, resource));
+  }
+};				// lisp_reader
+
+#endif // CPPLISPREADER_TOKEN_RANGE_HPP
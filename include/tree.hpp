@@ -0,0 +1,247 @@
+#ifndef CPPLISPREADER_TREE_HPP
+#define CPPLISPREADER_TREE_HPP
+
+#include "reader.hpp"
+#include "value.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <memory_resource>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace lisp_reader {
+  struct Node;
+
+  // The children of a list node, an array owned by the builder
+  class NodeList {
+  public:
+    NodeList() : _data(nullptr), _size(0) {}
+    NodeList(const Node *const *data, std::size_t size) : _data(data), _size(size) {}
+
+    std::size_t size() const {return _size;}
+    bool empty() const {return _size == 0;}
+    const Node *operator[](std::size_t i) const {return _data[i];}
+    const Node *const *begin() const {return _data;}
+    const Node *const *end() const {return _data + _size;}
+
+    bool operator==(const NodeList &rhs) const {return std::equal(begin(), end(), rhs.begin(), rhs.end());}
+  private:
+    const Node *const *_data;
+    std::size_t _size;
+  };
+
+  // A node of a parsed tree, either an atom or a list of nodes
+  struct Node {
+    Value value;
+    // Structural hash, built up from the atom values and the hashes of the children as the tree is built
+    std::size_t hash;
+    NodeList children;
+
+    TokenType type() const {return value.type();}
+    bool isList() const {return value.isList();}
+  };
+
+  namespace detail {
+    inline std::size_t hashCombine(std::size_t seed, std::size_t h) {
+      return seed ^ (h + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+    }
+
+    // Compares a node with one already built, whose children are compared by identity
+    // This is all hash-consing needs, since the children of both have been shared already
+    struct ShallowNodeHash {
+      std::size_t operator()(const Node *n) const {return n->hash;}
+    };
+    struct ShallowNodeEqual {
+      bool operator()(const Node *a, const Node *b) const {
+	return a->hash == b->hash && a->value == b->value && a->children == b->children;
+      }
+    };
+  } // detail
+
+  // Checks whether two trees are structurally identical
+  // Trees built by the same hash-consing TreeBuilder are identical exactly when they are the same node,
+  // so this returns straight away for them. Otherwise differing hashes settle most mismatches without a walk
+  inline bool equal(const Node *a, const Node *b) {
+    std::vector<std::pair<const Node *, const Node *>> todo{{a, b}};
+    while(!todo.empty()) {
+      auto [x, y] = todo.back();
+      todo.pop_back();
+      if(x == y) continue;
+      if(x->hash != y->hash || x->value != y->value || x->children.size() != y->children.size())
+	return false;
+
+      for(std::size_t i = 0; i < x->children.size(); ++i)
+	todo.emplace_back(x->children[i], y->children[i]);
+    }
+
+    return true;
+  }
+
+  // An element of a piece of input read by TreeBuilder::readPartial()
+  struct PartialItem {
+    enum Kind { NODE, OPEN, CLOSE };
+    Kind kind;
+    const Node *node;		// Only set for NODE
+  };
+
+  // Builds trees out of tokens, owning every node it builds
+  // With hash-consing on, every structurally identical subtree is built once and shared: atoms and lists are
+  // looked up by their structural hash as they are completed, bottom up, so a lookup only ever compares the
+  // values and child pointers of a single node. Repeated subforms then cost one pointer each, and comparing
+  // two trees from the same builder is a pointer compare
+  // Shared nodes are immutable, which is why the builder only hands out const nodes
+  // Atoms hold compact Values, whose symbols and strings live in the builder's ValueArena, subject to
+  // limits.maxSymbols. When hash-consing, strings are interned there too
+  // Nodes and child arrays are carved out of the same arena, the rest of the builder's bookkeeping is
+  // allocated from resource directly
+  class TreeBuilder {
+  public:
+    explicit TreeBuilder(bool hashCons = false, ReaderLimits limits = {},
+			 std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : _arena(limits, hashCons, resource), _nodes(_arena.memory()), _table(resource), _resource(resource),
+	_hashCons(hashCons), _shared(0), _atoms(0) {}
+
+    bool hashConsing() const {return _hashCons;}
+    const ValueArena &arena() const {return _arena;}
+    // Number of nodes built, and number of times an existing node was handed out instead of building one
+    std::size_t size() const {return _nodes.size();}
+    std::size_t shared() const {return _shared;}
+
+    // Builds an atom from a token, which must not be a parenthesis
+    const Node *atom(const Token &token) {return _atom(token, _atoms);}
+
+    // Builds a list out of nodes built by this builder
+    const Node *list(const std::vector<const Node *> &children) {return _list(children.data(), children.size());}
+    const Node *list(const Node *const *children, std::size_t count) {return _list(children, count);}
+
+    // Reads every remaining form from a tokenizer, returning the top-level nodes in order
+    // Anything with a Tokenizer's canRead(), read() and count() will do, like a TokenPipeline
+    // Comments are dropped. Unbalanced parenthesis are an error
+    template <typename Tok>
+    std::vector<const Node *> read(Tok &tok) {
+      // Children of all the open lists, one after the other, and where each open list starts in there
+      std::pmr::vector<const Node *> stack(_resource);
+      std::pmr::vector<std::size_t> frames(_resource);
+
+      _read(tok, stack, frames, []() {throw "Unexpected closing parenthesis";});
+      if(!frames.empty()) throw "Missing closing parenthesis";
+
+      return std::vector<const Node *>(stack.begin(), stack.end());
+    }
+
+    // Reads a piece of the input, whose lists may have started in an earlier piece or end in a later one
+    // Appends the complete forms to items, with a CLOSE wherever a list of an earlier piece is closed and an OPEN
+    // for every list still open at the end, in input order. Those can only be all the CLOSEs, then all the OPENs
+    // If reading fails, items still has everything before the error when it is rethrown
+    template <typename Tok>
+    void readPartial(Tok &tok, std::vector<PartialItem> &items) {
+      std::pmr::vector<const Node *> stack(_resource);
+      std::pmr::vector<std::size_t> frames(_resource);
+      // Outside of any list the stack only holds complete forms
+      auto flush = [&]() {
+		     std::size_t i = 0;
+		     for(std::size_t frame : frames) {
+		       for(; i < frame; ++i) items.push_back({PartialItem::NODE, stack[i]});
+		       items.push_back({PartialItem::OPEN, nullptr});
+		     }
+		     for(; i < stack.size(); ++i) items.push_back({PartialItem::NODE, stack[i]});
+		     stack.clear();
+		     frames.clear();
+		   };
+
+      try {
+	_read(tok, stack, frames, [&]() {
+				    flush();
+				    items.push_back({PartialItem::CLOSE, nullptr});
+				  });
+      }
+      catch(...) {
+	flush();
+	throw;
+      }
+      flush();
+    }
+  private:
+    ValueArena _arena;
+    // A deque never moves its elements, so nodes can point at each other
+    std::pmr::deque<Node> _nodes;
+    std::pmr::unordered_set<const Node *, detail::ShallowNodeHash, detail::ShallowNodeEqual> _table;
+    std::pmr::memory_resource *_resource;
+    bool _hashCons;
+    std::size_t _shared;
+    std::size_t _atoms;
+
+    // Builds the forms of tok onto stack, calling unmatchedClose() for a closing parenthesis outside of any list
+    template <typename Tok, typename F>
+    void _read(Tok &tok, std::pmr::vector<const Node *> &stack, std::pmr::vector<std::size_t> &frames,
+	       F unmatchedClose) {
+      while(tok.canRead()) {
+	Token t = tok.read();
+	switch(t.first) {
+	case TokenType::COMMENT:
+	  break;
+	case TokenType::OPEN_PARENTHESIS:
+	  frames.push_back(stack.size());
+	  break;
+	case TokenType::CLOSE_PARENTHESIS: {
+	  if(frames.empty()) {
+	    unmatchedClose();
+	    break;
+	  }
+
+	  std::size_t start = frames.back();
+	  frames.pop_back();
+	  const Node *n = _list(stack.data() + start, stack.size() - start);
+	  stack.resize(start);
+	  stack.push_back(n);
+	  break;
+	}
+	default:
+	  stack.push_back(_atom(t, tok.count() - 1));
+	  break;
+	}
+      }
+    }
+
+    // token is the index of the token for a LimitError
+    const Node *_atom(const Token &token, std::size_t index) {
+      Value v = _arena.value(token, index);
+      ++_atoms;
+
+      return _add(Node{v, v.hash(), {}});
+    }
+
+    // Builds a list of count children, which are copied into the arena unless an identical list exists
+    const Node *_list(const Node *const *children, std::size_t count) {
+      Node n{Value::list(), Value::list().hash(), NodeList(children, count)};
+      for(const Node *child : n.children) n.hash = detail::hashCombine(n.hash, child->hash);
+
+      return _add(std::move(n));
+    }
+
+    const Node *_add(Node &&n) {
+      if(_hashCons) {
+	auto it = _table.find(&n);
+	if(it != _table.end()) {
+	  ++_shared;
+	  return *it;
+	}
+      }
+
+      if(!n.children.empty()) {
+	void *p = _arena.memory()->allocate(n.children.size() * sizeof(const Node *), alignof(const Node *));
+	const Node **data = static_cast<const Node **>(p);
+	std::copy(n.children.begin(), n.children.end(), data);
+	n.children = NodeList(data, n.children.size());
+      }
+      const Node *ret = &_nodes.emplace_back(std::move(n));
+      if(_hashCons) _table.insert(ret);
+      return ret;
+    }
+  };
+};				// lisp_reader
+
+#endif // CPPLISPREADER_TREE_HPP
@@ -0,0 +1,252 @@
+#ifndef CPPLISPREADER_VALUE_HPP
+#define CPPLISPREADER_VALUE_HPP
+
+#include "reader.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <string_view>
+#include <unordered_map>
+
+namespace lisp_reader {
+  // A length-prefixed string stored in a ValueArena, the characters follow the header
+  struct ArenaString {
+    std::size_t size;
+
+    std::string_view view() const {return {reinterpret_cast<const char *>(this + 1), size};}
+  };
+
+  // An 8-byte value for the atoms of parsed trees, in place of a Token
+  // Doubles are stored as themselves, every NaN being folded into a single canonical one. The remaining NaN space
+  // (sign bit and quiet bit set) holds the other types: a tag in the top 16 bits and a 48-bit payload, which is
+  // the value itself for ints, floats and small fractions, or a pointer into a ValueArena for symbols, strings,
+  // comments and fractions too large to pack
+  // Values pointing into an arena are only valid for as long as the arena
+  class Value {
+  public:
+    // An empty list
+    Value() : _bits(_tagged(LIST, 0)) {}
+
+    static Value list() {return Value();}
+    static Value fromInt(int i) {return Value(_tagged(INT, static_cast<std::uint32_t>(i)));}
+    static Value fromFloat(float f) {
+      std::uint32_t u;
+      std::memcpy(&u, &f, sizeof(f));
+      return Value(_tagged(FLOAT, u));
+    }
+    static Value fromDouble(double d) {
+      std::uint64_t u = CANONICAL_NAN;
+      if(!std::isnan(d)) std::memcpy(&u, &d, sizeof(d));
+      return Value(u);
+    }
+
+    TokenType type() const {
+      switch(_tag()) {
+      case LIST:	return TokenType::OPEN_PARENTHESIS;
+      case INT:		return TokenType::INT;
+      case FLOAT:	return TokenType::FLOAT;
+      case FRACTION:
+      case BOXED_FRACTION:	return TokenType::FRACTION;
+      case SYMBOL:	return TokenType::SYMBOL;
+      case STRING:	return TokenType::STRING;
+      case COMMENT:	return TokenType::COMMENT;
+      default:		return TokenType::DOUBLE;
+      }
+    }
+    bool isList() const {return _tag() == LIST;}
+
+    // Accessors, only valid for values of the matching type
+    int asInt() const {return static_cast<int>(static_cast<std::uint32_t>(_bits));}
+    float asFloat() const {
+      std::uint32_t u = static_cast<std::uint32_t>(_bits);
+      float f;
+      std::memcpy(&f, &u, sizeof(f));
+      return f;
+    }
+    double asDouble() const {
+      double d;
+      std::memcpy(&d, &_bits, sizeof(d));
+      return d;
+    }
+    Fraction asFraction() const {
+      if(_tag() == BOXED_FRACTION) return *static_cast<const Fraction *>(_ptr());
+      return Fraction(_signExtend24(_bits >> 24), _signExtend24(_bits));
+    }
+    // The text of a symbol, string or comment
+    std::string_view asString() const {return static_cast<const ArenaString *>(_ptr())->view();}
+
+    // The raw representation, two values with the same bits are always equal
+    std::uint64_t bits() const {return _bits;}
+
+    // Converts back to the token this value was built from
+    std::optional<TokenValue> toTokenValue() const {
+      switch(type()) {
+      case TokenType::OPEN_PARENTHESIS:	return std::nullopt;
+      case TokenType::INT:		return asInt();
+      case TokenType::FLOAT:		return asFloat();
+      case TokenType::DOUBLE:		return asDouble();
+      case TokenType::FRACTION:		return asFraction();
+      default:				return std::string(asString());
+      }
+    }
+    Token toToken() const {return Token{type(), toTokenValue()};}
+
+    // Hashes by content, so equal values hash the same even when they come from different arenas
+    std::size_t hash() const {
+      if(_boxed()) {
+	if(_tag() == BOXED_FRACTION) {
+	  Fraction f = asFraction();
+	  return std::hash<std::uint64_t>()((static_cast<std::uint64_t>(static_cast<std::uint32_t>(f.getNum())) << 32) |
+					    static_cast<std::uint32_t>(f.getDen()));
+	}
+	return std::hash<std::string_view>()(asString()) ^ _tag();
+      }
+
+      return std::hash<std::uint64_t>()(_bits);
+    }
+
+    // Floating point values compare by their bits, so 0.0 and -0.0 differ while NaN equals itself
+    // Values pointing into an arena compare by content unless they point at the same place
+    bool operator==(const Value &rhs) const {
+      if(_bits == rhs._bits) return true;
+      if(_tag() != rhs._tag() || !_boxed()) return false;
+      if(_tag() == BOXED_FRACTION) return asFraction() == rhs.asFraction();
+
+      return asString() == rhs.asString();
+    }
+    bool operator!=(const Value &rhs) const {return !(*this == rhs);}
+  private:
+    friend class ValueArena;
+
+    // Tags live in the top 16 bits, everything below 0xfff8 there is a double
+    enum Tag : std::uint64_t {
+      LIST = 0xfff8, INT, FLOAT, FRACTION, BOXED_FRACTION, SYMBOL, STRING, COMMENT
+    };
+    static constexpr std::uint64_t CANONICAL_NAN = 0x7ff8000000000000ull;
+    static constexpr std::uint64_t PAYLOAD_MASK = (1ull << 48) - 1;
+
+    std::uint64_t _bits;
+
+    explicit Value(std::uint64_t bits) : _bits(bits) {}
+
+    static std::uint64_t _tagged(Tag tag, std::uint64_t payload) {return (tag << 48) | payload;}
+    // User-space pointers fit in the 48-bit payload on x86-64 and AArch64
+    static Value _pointer(Tag tag, const void *p) {
+      return Value(_tagged(tag, static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(p))));
+    }
+    static int _signExtend24(std::uint64_t v) {
+      return static_cast<int>(static_cast<std::uint32_t>(v << 8)) >> 8;
+    }
+
+    std::uint64_t _tag() const {return _bits >> 48;}
+    bool _boxed() const {return _tag() >= BOXED_FRACTION;}
+    const void *_ptr() const {return reinterpret_cast<const void *>(static_cast<std::uintptr_t>(_bits & PAYLOAD_MASK));}
+  };
+  static_assert(sizeof(Value) == 8, "Value must stay a single word");
+
+  // Owns what Values point to: symbols, interned once each, strings and comments, and fractions too large to pack
+  // Everything is bump allocated out of large blocks taken from resource, and freed all at once with the arena
+  // The number of distinct symbols is bounded by ReaderLimits::maxSymbols, as a flood of unique symbols from
+  // untrusted input would otherwise grow the symbol table without bound
+  // With internStrings, strings and comments are deduplicated like symbols, though without a limit
+  class ValueArena {
+  public:
+    explicit ValueArena(ReaderLimits limits = {}, bool internStrings = false,
+			std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : _limits(limits), _internStrings(internStrings), _symbols(resource), _strings(resource), _comments(resource),
+	_mem(std::make_unique<std::pmr::monotonic_buffer_resource>(BLOCK_SIZE, resource)) {}
+    ValueArena(const ValueArena &) = delete;
+    ValueArena &operator=(const ValueArena &) = delete;
+    ValueArena(ValueArena &&) = default;
+    ValueArena &operator=(ValueArena &&) = default;
+
+    // Number of distinct symbols interned so far
+    std::size_t symbols() const {return _symbols.size();}
+
+    // The arena itself, for anything else that should live and die with the values
+    std::pmr::memory_resource *memory() const {return _mem.get();}
+
+    // Converts a token, token is its index for a LimitError
+    Value value(const Token &t, std::size_t token = 0) {
+      switch(t.first) {
+      case TokenType::OPEN_PARENTHESIS:
+      case TokenType::CLOSE_PARENTHESIS:
+	return Value::list();
+      case TokenType::INT:
+	return Value::fromInt(std::get<int>(*t.second));
+      case TokenType::FLOAT:
+	return Value::fromFloat(std::get<float>(*t.second));
+      case TokenType::DOUBLE:
+	return Value::fromDouble(std::get<double>(*t.second));
+      case TokenType::FRACTION:
+	return fraction(std::get<Fraction>(*t.second));
+      case TokenType::SYMBOL:
+	return symbol(std::get<SmallString>(*t.second), token);
+      case TokenType::STRING:
+	return Value::_pointer(Value::STRING, _string(std::get<SmallString>(*t.second), _strings));
+      default:
+	return Value::_pointer(Value::COMMENT, _string(std::get<SmallString>(*t.second), _comments));
+      }
+    }
+
+    // Returns the symbol with this name, interning it if it is new
+    Value symbol(std::string_view name, std::size_t token = 0) {
+      auto it = _symbols.find(name);
+      if(it != _symbols.end()) return Value::_pointer(Value::SYMBOL, it->second);
+
+      if(_limits.maxSymbols && _symbols.size() >= _limits.maxSymbols)
+	throw LimitError(Limit::SYMBOLS, _limits.maxSymbols, token);
+      const ArenaString *s = _copy(name);
+      _symbols.emplace(s->view(), s);
+      return Value::_pointer(Value::SYMBOL, s);
+    }
+
+    Value fraction(const Fraction &f) {
+      // Packed as two signed 24-bit halves when both fit
+      auto fits = [](int v) {return v >= -(1 << 23) && v < (1 << 23);};
+      if(fits(f.getNum()) && fits(f.getDen()))
+	return Value(Value::_tagged(Value::FRACTION, (static_cast<std::uint64_t>(f.getNum() & 0xffffff) << 24) |
+				    static_cast<std::uint64_t>(f.getDen() & 0xffffff)));
+
+      return Value::_pointer(Value::BOXED_FRACTION, new(_allocate(sizeof(Fraction), alignof(Fraction))) Fraction(f));
+    }
+  private:
+    typedef std::pmr::unordered_map<std::string_view, const ArenaString *> Table;
+
+    static constexpr std::size_t BLOCK_SIZE = 64 << 10;
+
+    ReaderLimits _limits;
+    bool _internStrings;
+    Table _symbols;
+    Table _strings;
+    Table _comments;
+    // Behind a pointer so the arena stays movable
+    std::unique_ptr<std::pmr::monotonic_buffer_resource> _mem;
+
+    void *_allocate(std::size_t size, std::size_t align) {return _mem->allocate(size, align);}
+
+    const ArenaString *_copy(std::string_view str) {
+      void *p = _allocate(sizeof(ArenaString) + str.size(), alignof(ArenaString));
+      ArenaString *s = new(p) ArenaString{str.size()};
+      std::memcpy(s + 1, str.data(), str.size());
+      return s;
+    }
+
+    const ArenaString *_string(std::string_view str, Table &table) {
+      if(!_internStrings) return _copy(str);
+
+      auto it = table.find(str);
+      if(it != table.end()) return it->second;
+      const ArenaString *s = _copy(str);
+      table.emplace(s->view(), s);
+      return s;
+    }
+  };
+};				// lisp_reader
+
+#endif // CPPLISPREADER_VALUE_HPP
@@ -0,0 +1,209 @@
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include "catch2/catch.hpp"
+
+#include "reader.hpp"
+#include "mmap_reader.hpp"
+#include "pipelined_reader.hpp"
+#include "corpus.hpp"
+#include "dfa_lexer.hpp"
+#include "token_pipeline.hpp"
+#include "parallel_parser.hpp"
+#include "paren_index.hpp"
+#include "tree.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+using lisp_reader::StringTokenizer;
+using lisp_reader::Token;
+using lisp_reader::TokenType;
+
+// Helper methods
+// Builds a single atom of the given size, starting with prefix and padded with fill
+std::string makeAtom(std::string_view prefix, char fill, std::size_t size) {
+  std::string atom(prefix);
+  atom.resize(size, fill);
+
+  return atom;
+}
+// Reads every token, returning the number of tokens read
+template <typename T>
+std::size_t readAll(T &tok) {
+  std::size_t cnt = 0;
+
+  while(tok.canRead()) {
+    tok.read();
+    ++cnt;
+  }
+
+  return cnt;
+}
+// Tokenizes the whole input, returning the number of tokens read
+std::size_t tokenizeAll(std::string_view str) {
+  StringTokenizer tok(str);
+
+  return readAll(tok);
+}
+
+
+TEST_CASE("Pathological 1 MB atoms", "[benchmark]") {
+  constexpr std::size_t MB = 1 << 20;
+
+  // Atoms that keep the state machine in its FLOAT/DOUBLE states for as long as possible
+  const std::string dots = makeAtom("1.1", '.', MB);
+  const std::string exps = makeAtom("1.1e", 'e', MB);
+  const std::string signs = makeAtom("1.1e+", '+', MB);
+  const std::string digits = makeAtom("1.1", '1', MB - 1) + "x";
+  const std::string symbol = makeAtom("a", 'a', MB);
+
+  BENCHMARK("1 MB of dots") {
+    return tokenizeAll(dots);
+  };
+  BENCHMARK("1 MB of exponent markers") {
+    return tokenizeAll(exps);
+  };
+  BENCHMARK("1 MB of signs") {
+    return tokenizeAll(signs);
+  };
+  BENCHMARK("1 MB float-like digits") {
+    return tokenizeAll(digits);
+  };
+  BENCHMARK("1 MB plain symbol") {
+    return tokenizeAll(symbol);
+  };
+}
+
+TEST_CASE("DFA lexer against the state machine", "[benchmark]") {
+  // Mixed tokens, where the nested switches of the state machine mispredict the most, and numbers only
+  std::string mixed, numbers;
+  lisp_reader::CorpusGenerator().generate(mixed, 4 << 20);
+  lisp_reader::CorpusOptions opts;
+  opts.mix.fill(0);
+  for(TokenType t : {TokenType::INT, TokenType::FLOAT, TokenType::DOUBLE, TokenType::FRACTION})
+    opts.mix[static_cast<int>(t)] = 1;
+  lisp_reader::CorpusGenerator(opts).generate(numbers, 4 << 20);
+
+  BENCHMARK("State machine, 4 MB mixed") {
+    return tokenizeAll(mixed);
+  };
+  BENCHMARK("DFA, 4 MB mixed") {
+    lisp_reader::DfaTokenizer tok(mixed);
+    return readAll(tok);
+  };
+  BENCHMARK("State machine, 4 MB numbers") {
+    return tokenizeAll(numbers);
+  };
+  BENCHMARK("DFA, 4 MB numbers") {
+    lisp_reader::DfaTokenizer tok(numbers);
+    return readAll(tok);
+  };
+}
+
+TEST_CASE("Events against tokens", "[benchmark]") {
+  std::string mixed;
+  lisp_reader::CorpusGenerator().generate(mixed, 4 << 20);
+
+  // Does as little as a consumer could with each token, so what remains is the cost of handing it over
+  struct Counter : lisp_reader::EventHandler<Counter> {
+    std::size_t cnt = 0;
+    void onOpen() {++cnt;}
+    void onClose() {++cnt;}
+    void onSymbol(std::string_view) {++cnt;}
+    void onString(std::string_view) {++cnt;}
+    void onComment(std::string_view) {++cnt;}
+    void onInt(int) {++cnt;}
+    void onDouble(double) {++cnt;}
+    void onFraction(const lisp_reader::Fraction &) {++cnt;}
+  };
+
+  BENCHMARK("Tokens, 4 MB mixed") {
+    return tokenizeAll(mixed);
+  };
+  BENCHMARK("Events, 4 MB mixed") {
+    StringTokenizer tok(mixed);
+    Counter counter;
+    tok.readEvents(counter);
+    return counter.cnt;
+  };
+}
+
+TEST_CASE("Building trees with lexing on another thread", "[benchmark]") {
+  std::string mixed;
+  lisp_reader::CorpusGenerator().generate(mixed, 4 << 20);
+
+  BENCHMARK("Single thread, 4 MB mixed") {
+    lisp_reader::TreeBuilder builder;
+    StringTokenizer tok(mixed);
+    return builder.read(tok).size();
+  };
+  for(std::size_t batchSize : {64, 512, 4096}) {
+    BENCHMARK("Pipelined, " + std::to_string(batchSize) + " token batches, 4 MB mixed") {
+      lisp_reader::TreeBuilder builder;
+      lisp_reader::TokenPipeline<lisp_reader::StringReader> pipeline(StringTokenizer(mixed), {batchSize, 8});
+      return builder.read(pipeline).size();
+    };
+  }
+}
+
+TEST_CASE("Building trees in parallel chunks", "[benchmark]") {
+  std::string mixed;
+  lisp_reader::CorpusGenerator().generate(mixed, 16 << 20);
+
+  BENCHMARK("Single thread, 16 MB mixed") {
+    lisp_reader::TreeBuilder builder;
+    StringTokenizer tok(mixed);
+    return builder.read(tok).size();
+  };
+  for(std::size_t threads : {1, 2, 4, 8}) {
+    lisp_reader::ParallelParserOptions opts;
+    opts.threads = threads;
+    opts.chunkSize = 1 << 20;
+    lisp_reader::ParallelParser parser(opts);
+    BENCHMARK(std::to_string(threads) + " threads, 1 MB chunks, 16 MB mixed") {
+      return parser.parse(mixed).size();
+    };
+  }
+}
+
+TEST_CASE("Indexing parenthesis against tokenizing", "[benchmark]") {
+  std::string mixed;
+  lisp_reader::CorpusGenerator().generate(mixed, 4 << 20);
+
+  BENCHMARK("Tokenizing, 4 MB mixed") {
+    return tokenizeAll(mixed);
+  };
+  BENCHMARK("Paren index, 4 MB mixed") {
+    return lisp_reader::ParenIndex(mixed).size();
+  };
+  BENCHMARK("Split points, 4 MB mixed") {
+    return lisp_reader::findSplitPoints(mixed, 1 << 16).size();
+  };
+}
+
+TEST_CASE("Reading a 4 MB file", "[benchmark]") {
+  std::filesystem::path path = std::filesystem::temp_directory_path() / "cpplispreader_bench.lisp";
+  {
+    // The same corpus on every run and every machine
+    std::string corpus;
+    lisp_reader::CorpusGenerator().generate(corpus, 4 << 20);
+    std::ofstream(path, std::ios::binary) << corpus;
+  }
+
+  BENCHMARK("StreamTokenizer") {
+    std::ifstream is(path);
+    lisp_reader::StreamTokenizer tok{lisp_reader::StreamReader(is)};
+    return readAll(tok);
+  };
+  BENCHMARK("MmapTokenizer") {
+    lisp_reader::MmapTokenizer tok{lisp_reader::MmapReader(path.string())};
+    return readAll(tok);
+  };
+  BENCHMARK("PipelinedTokenizer") {
+    lisp_reader::PipelinedTokenizer tok{lisp_reader::PipelinedFileReader(path.string())};
+    return readAll(tok);
+  };
+
+  std::filesystem::remove(path);
+}
@@ -0,0 +1,135 @@
+#include "lisp_reader.h"
+#include "reader.hpp"
+
+#include <cstring>
+#include <new>
+
+using lisp_reader::StringReader;
+using lisp_reader::StringTokenizer;
+using lisp_reader::Token;
+using lisp_reader::TokenType;
+using lisp_reader::ReaderLimits;
+
+// The tokenizer behind the opaque C handle
+struct lr_tokenizer {
+  lr_tokenizer(std::string_view str, ReaderLimits limits)
+    : tok(StringReader(str), limits) {}
+
+  StringTokenizer tok;
+  // A token that was read but did not fit into the previous batch
+  std::optional<Token> pending;
+  // Set once reading failed, every further call reports the same error
+  std::string error;
+  bool failed = false;
+};
+
+namespace {
+  static_assert(static_cast<int>(TokenType::STRING) == LR_STRING, "lr_token_type must mirror lisp_reader::TokenType");
+  static_assert(sizeof(lr_token::length) >= sizeof(std::size_t), "lr_token.length must hold the length of any token");
+
+  // Appends a token to the batch, returns false if it (or its text) does not fit
+  bool writeToken(const Token &t, lr_batch &batch) {
+    if(batch.token_count == batch.token_capacity) return false;
+
+    lr_token &out = batch.tokens[batch.token_count];
+    out.type = static_cast<uint32_t>(t.first);
+    out.length = 0;
+    out.value.i = 0;
+
+    if(t.second) {
+      bool fits = std::visit([&out, &batch](const auto &val) {
+			       using V = std::decay_t<decltype(val)>;
+			       if constexpr (std::is_same_v<V, lisp_reader::SmallString>) {
+				 if(val.size() > batch.text_capacity - batch.text_size) return false;
+
+				 std::memcpy(batch.text + batch.text_size, val.data(), val.size());
+				 out.value.text_offset = batch.text_size;
+				 out.length = val.size();
+				 batch.text_size += val.size();
+			       }
+			       else if constexpr (std::is_same_v<V, lisp_reader::Fraction>) {
+				 out.value.frac.num = val.getNum();
+				 out.value.frac.den = val.getDen();
+			       }
+			       else if constexpr (std::is_integral_v<V>)
+				 out.value.i = val;
+			       else
+				 out.value.d = val;
+
+			       return true;
+			     }, *t.second);
+      if(!fits) return false;
+    }
+
+    ++batch.token_count;
+    return true;
+  }
+
+  // Records an error on the tokenizer, it stays in that state
+  // Tokens already in the batch are still handed out, the error is reported by the next call
+  lr_status fail(lr_tokenizer &tok, const lr_batch &batch, std::string msg) {
+    tok.failed = true;
+    tok.error = std::move(msg);
+    tok.pending.reset();
+
+    return batch.token_count ? LR_OK : LR_ERROR;
+  }
+} // namespace
+
+extern "C" {
+  lr_tokenizer *lr_tokenizer_new(const char *data, size_t size, const lr_limits *limits) {
+    ReaderLimits l;
+    if(limits) {
+      l.maxTokenLength = limits->max_token_length;
+      l.maxStringLength = limits->max_string_length;
+      l.maxDepth = limits->max_depth;
+      l.maxTokens = limits->max_tokens;
+    }
+
+    return new(std::nothrow) lr_tokenizer(std::string_view(data, size), l);
+  }
+
+  lr_status lr_next_token_batch(lr_tokenizer *tok, lr_batch *batch) {
+    // Without room for a token no call could make progress, and growing the text buffer would not help
+    if(!tok || !batch || !batch->token_capacity || !batch->tokens || (batch->text_capacity && !batch->text))
+      return LR_INVALID_ARGUMENT;
+    batch->token_count = 0;
+    batch->text_size = 0;
+    if(tok->failed) return LR_ERROR;
+
+    try {
+      // Flush the token left over from the last batch first
+      if(tok->pending) {
+	if(!writeToken(*tok->pending, *batch))
+	  return LR_TEXT_TOO_SMALL;
+	tok->pending.reset();
+      }
+
+      while(batch->token_count < batch->token_capacity && tok->tok.canRead()) {
+	Token t = tok->tok.read();
+	if(!writeToken(t, *batch)) {
+	  tok->pending = std::move(t);
+	  break;
+	}
+      }
+
+      if(batch->token_count) return LR_OK;
+      if(tok->pending) return LR_TEXT_TOO_SMALL;
+      return LR_END;
+    }
+    catch(const char *msg) {
+      return fail(*tok, *batch, msg);
+    }
+    catch(const std::exception &e) {
+      return fail(*tok, *batch, e.what());
+    }
+  }
+
+  const char *lr_error(const lr_tokenizer *tok) {
+    return tok->error.c_str();
+  }
+
+  void lr_free(lr_tokenizer *tok) {
+    delete tok;
+  }
+} // extern "C"
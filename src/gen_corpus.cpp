@@ -0,0 +1,164 @@
+// gen_corpus: writes a synthetic, reproducible Lisp corpus for benchmarks
+// The same options always produce the same bytes, on any machine
+
+#include "corpus.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+using lisp_reader::CorpusGenerator;
+using lisp_reader::CorpusOptions;
+using lisp_reader::TokenType;
+
+namespace {
+  constexpr const char *USAGE =
+    "Usage: gen_corpus [options]\n"
+    "Writes synthetic Lisp covering every kind of token the reader accepts\n"
+    "\n"
+    "Options:\n"
+    "  -o FILE                 Write to FILE instead of stdout\n"
+    "  --size N[K|M|G]         Stop once at least N bytes were written (default: 1M)\n"
+    "  --seed N                Seed of the generator (default: 1)\n"
+    "  --max-depth N           Maximum nesting depth of lists (default: 8)\n"
+    "  --nest P                Probability that a list element is a list, halved at every level (default: 0.3)\n"
+    "  --max-list-length N     Maximum number of elements of a list (default: 8)\n"
+    "  --mix TYPE=W,...        Relative weights of atoms, TYPE is one of symbol, comment, int, double, float,\n"
+    "                          fraction or string (default: symbol=30,comment=3,int=20,double=5,float=5,\n"
+    "                          fraction=3,string=10)\n"
+    "  --max-symbol-length N   (default: 16)\n"
+    "  --max-string-length N   (default: 48)\n"
+    "  --max-comment-length N  (default: 60)\n"
+    "  --escape-rate P         Fraction of symbols holding an escape (default: 0.02)\n"
+    "  -h, --help              Show this message\n";
+
+  [[noreturn]] void usageError(const std::string &msg) {
+    std::cerr << "gen_corpus: " << msg << '\n' << USAGE;
+    std::exit(2);
+  }
+
+  // Parses a count, with an optional K, M or G suffix
+  std::size_t parseSize(const char *opt, const char *val) {
+    char *end = nullptr;
+    unsigned long long n = val ? std::strtoull(val, &end, 10) : 0;
+    if(!val || end == val) usageError(std::string(opt) + " requires a number");
+
+    switch(*end) {
+    case 'G': n <<= 10; [[fallthrough]];
+    case 'M': n <<= 10; [[fallthrough]];
+    case 'K': n <<= 10; ++end; break;
+    default: break;
+    }
+    if(*end != '\0') usageError(std::string(opt) + " requires a number");
+
+    return static_cast<std::size_t>(n);
+  }
+
+  double parseProbability(const char *opt, const char *val) {
+    char *end = nullptr;
+    double p = val ? std::strtod(val, &end) : -1;
+    if(!val || *end != '\0' || p < 0 || p > 1) usageError(std::string(opt) + " requires a probability");
+
+    return p;
+  }
+
+  double parseWeight(const char *opt, const char *val) {
+    char *end = nullptr;
+    double w = val ? std::strtod(val, &end) : -1;
+    if(!val || *end != '\0' || w < 0) usageError(std::string(opt) + " requires a non-negative weight");
+
+    return w;
+  }
+
+  // Parses TYPE=W pairs, types left out keep their default weight
+  void parseMix(const char *val, CorpusOptions &opts) {
+    if(!val) usageError("--mix requires a list of weights");
+
+    std::string_view rest = val;
+    while(!rest.empty()) {
+      std::string_view item = rest.substr(0, rest.find(','));
+      rest.remove_prefix(std::min(rest.size(), item.size() + 1));
+
+      std::size_t eq = item.find('=');
+      std::string name(item.substr(0, eq));
+      for(char &c : name) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+      int type = static_cast<int>(TokenType::SYMBOL);
+      while(type < static_cast<int>(TokenType::END) && lisp_reader::tokenTypeLabels[type] != name) ++type;
+      if(eq == std::string_view::npos || type == static_cast<int>(TokenType::END))
+	usageError("bad --mix entry " + std::string(item));
+
+      opts.mix[type] = parseWeight("--mix", std::string(item.substr(eq + 1)).c_str());
+    }
+  }
+} // namespace
+
+int main(int argc, char **argv) {
+  CorpusOptions opts;
+  std::size_t size = 1 << 20;
+  std::string output;
+
+  for(int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    const char *next = i + 1 < argc ? argv[i + 1] : nullptr;
+
+    if(arg == "-h" || arg == "--help") {
+      std::cout << USAGE;
+      return 0;
+    }
+    else if(arg == "-o") {
+      if(!next) usageError("-o requires a file");
+      output = argv[++i];
+    }
+    else if(arg == "--size") size = parseSize(argv[i++], next);
+    else if(arg == "--seed") opts.seed = parseSize(argv[i++], next);
+    else if(arg == "--max-depth") opts.maxDepth = parseSize(argv[i++], next);
+    else if(arg == "--nest") opts.nestProbability = parseProbability(argv[i++], next);
+    else if(arg == "--max-list-length") opts.maxListLength = parseSize(argv[i++], next);
+    else if(arg == "--mix") {
+      parseMix(next, opts);
+      ++i;
+    }
+    else if(arg == "--max-symbol-length") opts.maxSymbolLength = parseSize(argv[i++], next);
+    else if(arg == "--max-string-length") opts.maxStringLength = parseSize(argv[i++], next);
+    else if(arg == "--max-comment-length") opts.maxCommentLength = parseSize(argv[i++], next);
+    else if(arg == "--escape-rate") opts.escapeRate = parseProbability(argv[i++], next);
+    else usageError("unknown option " + std::string(arg));
+  }
+
+  std::ofstream file;
+  if(!output.empty()) {
+    file.open(output, std::ios::binary);
+    if(!file) {
+      std::cerr << "gen_corpus: cannot open " << output << '\n';
+      return 1;
+    }
+  }
+  std::ostream &os = output.empty() ? std::cout : file;
+
+  try {
+    CorpusGenerator gen(opts);
+    // Generated and written a block at a time, so the size of the corpus does not matter
+    constexpr std::size_t BLOCK = 1 << 20;
+    std::string buf;
+    buf.reserve(2 * BLOCK);
+    for(std::size_t written = 0; written < size; written += buf.size()) {
+      buf.clear();
+      gen.generate(buf, std::min(BLOCK, size - written));
+      os.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+    }
+  }
+  catch(const std::invalid_argument &e) {
+    usageError(e.what());
+  }
+
+  os.flush();
+  if(!os) {
+    std::cerr << "gen_corpus: write failed\n";
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,447 @@
+// gen_dfa: compiles the atom grammar into the tables of a minimal DFA, run by the build
+// The rules become an NFA (Thompson's construction), the NFA a DFA (subset construction), and the DFA is
+// minimized by partition refinement. See grammar/atoms.grammar for the format
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <queue>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+  constexpr const char *USAGE = "Usage: gen_dfa GRAMMAR OUTPUT\n";
+
+  // Actions of the stop classes, in the order their states follow the scanning ones
+  const std::array<std::string, 3> ACTIONS{"end", "escape", "illegal"};
+  const std::array<std::string, 3> ACTION_STATES{"END_ATOM", "ESCAPE", "ILLEGAL"};
+
+  std::string grammarPath;
+  std::size_t lineNo = 0;
+
+  [[noreturn]] void fail(const std::string &msg) {
+    std::cerr << "gen_dfa: " << grammarPath;
+    if(lineNo) std::cerr << ':' << lineNo;
+    std::cerr << ": " << msg << '\n';
+    std::exit(1);
+  }
+
+  // Thompson NFA, edges are labelled with character classes, -1 for epsilon
+  struct Nfa {
+    struct State {
+      std::vector<std::pair<int, int>> edges;
+      int token = -1;		// Index of the token accepted here
+    };
+    std::vector<State> states;
+
+    int add() {
+      states.emplace_back();
+      return static_cast<int>(states.size()) - 1;
+    }
+    void edge(int from, int cls, int to) {states[from].edges.emplace_back(cls, to);}
+  };
+
+  // A piece of the NFA under construction, from start to accept
+  struct Fragment {
+    int start, accept;
+  };
+
+  struct Grammar {
+    // Class 0 is OTHER, the stop classes come after the ones the rules use
+    std::vector<std::string> classes{"OTHER"};
+    std::size_t ruleClasses = 1;
+    std::vector<int> stopActions;	// By stop class, index into ACTIONS
+    std::array<int, 256> classOf{};
+    std::map<std::string, std::vector<std::string>> lets;
+    // Token types by priority, "END" for rejected atoms
+    std::vector<std::string> tokens;
+    std::string fallback;
+    Nfa nfa;
+    int start = -1;
+  };
+
+  // Splits a rule into names and operators
+  std::vector<std::string> lex(const std::string &rule) {
+    std::vector<std::string> ret;
+    for(std::size_t i = 0; i < rule.size();) {
+      unsigned char c = rule[i];
+      if(std::isspace(c)) ++i;
+      else if(std::isalpha(c) || c == '_') {
+	std::size_t j = i;
+	while(j < rule.size() && (std::isalnum(static_cast<unsigned char>(rule[j])) || rule[j] == '_')) ++j;
+	ret.push_back(rule.substr(i, j - i));
+	i = j;
+      }
+      else if(std::string_view("()|?*+").find(c) != std::string_view::npos) ret.emplace_back(1, rule[i++]);
+      else fail(std::string("unexpected '") + rule[i] + "' in rule");
+    }
+
+    return ret;
+  }
+
+  // Recursive descent over the tokens of a rule, building its fragment
+  class RuleParser {
+  public:
+    RuleParser(Grammar &g, const std::vector<std::string> &toks) : _g(g), _toks(toks), _i(0) {}
+
+    Fragment parse() {
+      if(_toks.empty()) fail("empty rule");
+      Fragment ret = _alternation();
+      if(_i != _toks.size()) fail("unexpected '" + _toks[_i] + "' in rule");
+      return ret;
+    }
+  private:
+    Grammar &_g;
+    const std::vector<std::string> &_toks;
+    std::size_t _i;
+
+    bool _at(const char *op) const {return _i < _toks.size() && _toks[_i] == op;}
+
+    Fragment _alternation() {
+      Fragment first = _sequence();
+      if(!_at("|")) return first;
+
+      Fragment ret{_g.nfa.add(), _g.nfa.add()};
+      _g.nfa.edge(ret.start, -1, first.start);
+      _g.nfa.edge(first.accept, -1, ret.accept);
+      while(_at("|")) {
+	++_i;
+	Fragment alt = _sequence();
+	_g.nfa.edge(ret.start, -1, alt.start);
+	_g.nfa.edge(alt.accept, -1, ret.accept);
+      }
+      return ret;
+    }
+
+    Fragment _sequence() {
+      Fragment ret = _postfix();
+      while(_i < _toks.size() && !_at("|") && !_at(")")) {
+	Fragment next = _postfix();
+	_g.nfa.edge(ret.accept, -1, next.start);
+	ret.accept = next.accept;
+      }
+      return ret;
+    }
+
+    Fragment _postfix() {
+      Fragment ret = _atom();
+      while(_at("?") || _at("*") || _at("+")) {
+	char op = _toks[_i++][0];
+	Fragment f{_g.nfa.add(), _g.nfa.add()};
+	_g.nfa.edge(f.start, -1, ret.start);
+	_g.nfa.edge(ret.accept, -1, f.accept);
+	if(op != '+') _g.nfa.edge(f.start, -1, f.accept);
+	if(op != '?') _g.nfa.edge(ret.accept, -1, ret.start);
+	ret = f;
+      }
+      return ret;
+    }
+
+    Fragment _atom() {
+      if(_i == _toks.size()) fail("rule ends too early");
+      const std::string &tok = _toks[_i++];
+      if(tok == "(") {
+	Fragment ret = _alternation();
+	if(!_at(")")) fail("missing ')' in rule");
+	++_i;
+	return ret;
+      }
+
+      auto let = _g.lets.find(tok);
+      if(let != _g.lets.end()) return RuleParser(_g, let->second).parse();
+
+      auto cls = std::find(_g.classes.begin(), _g.classes.begin() + _g.ruleClasses, tok);
+      if(cls == _g.classes.begin() + _g.ruleClasses) fail("unknown name " + tok + " in rule");
+      Fragment ret{_g.nfa.add(), _g.nfa.add()};
+      _g.nfa.edge(ret.start, static_cast<int>(cls - _g.classes.begin()), ret.accept);
+      return ret;
+    }
+  };
+
+  // Parses the characters of a class, marking them as cls
+  void parseChars(Grammar &g, std::istringstream &is, int cls) {
+    std::string item;
+    bool any = false;
+    while(is >> item) {
+      int first, last;
+      if(item.size() == 1) first = last = static_cast<unsigned char>(item[0]);
+      else if(item.size() == 3 && item[1] == '-') {
+	first = static_cast<unsigned char>(item[0]);
+	last = static_cast<unsigned char>(item[2]);
+      }
+      else if(item.size() == 2 && item[0] == '\\') {
+	std::size_t esc = std::string_view("st\\nrfv").find(item[1]);
+	if(esc == std::string_view::npos) fail("unknown escape " + item);
+	first = last = " \t\\\n\r\f\v"[esc];
+      }
+      else fail("bad character " + item);
+
+      for(int c = first; c <= last; ++c) {
+	if(g.classOf[c]) fail("character " + item + " is in two classes");
+	g.classOf[c] = cls;
+      }
+      any = true;
+    }
+    if(!any) fail("class without characters");
+  }
+
+  Grammar parseGrammar(std::istream &in) {
+    Grammar g;
+    std::vector<int> tokenStarts;
+    bool stops = false;
+
+    std::string line;
+    for(lineNo = 1; std::getline(in, line); ++lineNo) {
+      std::istringstream is(line);
+      std::string kind;
+      if(!(is >> kind) || kind[0] == '#') continue;
+
+      if(kind == "class" || kind == "stop") {
+	std::string name;
+	if(!(is >> name) || std::find(g.classes.begin(), g.classes.end(), name) != g.classes.end())
+	  fail("missing or duplicate class name");
+	if(kind == "class" && stops) fail("classes must come before the stops");
+	if(kind == "stop") {
+	  std::string action;
+	  is >> action;
+	  auto it = std::find(ACTIONS.begin(), ACTIONS.end(), action);
+	  if(it == ACTIONS.end()) fail("unknown stop action " + action);
+	  g.stopActions.push_back(static_cast<int>(it - ACTIONS.begin()));
+	  stops = true;
+	}
+	g.classes.push_back(name);
+	if(kind == "class") g.ruleClasses = g.classes.size();
+	parseChars(g, is, static_cast<int>(g.classes.size()) - 1);
+	continue;
+      }
+      if(kind == "default") {
+	if(!(is >> g.fallback)) fail("default requires a token type");
+	continue;
+      }
+
+      // The rest is NAME = RULE, or = RULE for reject
+      std::string name, eq;
+      if(kind != "reject") is >> name;
+      is >> eq;
+      if(eq != "=") fail("expected '=' after " + kind);
+      std::string rule;
+      std::getline(is, rule);
+      std::vector<std::string> toks = lex(rule);
+
+      if(kind == "let") {
+	// Only names defined before may be used, so lets can not recurse
+	RuleParser(g, toks).parse();
+	g.lets[name] = toks;
+      }
+      else if(kind == "token" || kind == "reject") {
+	Fragment f = RuleParser(g, toks).parse();
+	g.nfa.states[f.accept].token = static_cast<int>(g.tokens.size());
+	g.tokens.push_back(kind == "reject" ? "END" : name);
+	tokenStarts.push_back(f.start);
+      }
+      else fail("unknown directive " + kind);
+    }
+    lineNo = 0;
+
+    if(g.tokens.empty()) fail("no tokens");
+    if(g.fallback.empty()) fail("missing default");
+    g.start = g.nfa.add();
+    for(int s : tokenStarts) g.nfa.edge(g.start, -1, s);
+
+    return g;
+  }
+
+  struct Dfa {
+    std::vector<std::vector<int>> next;	// By state and rule class
+    std::vector<std::string> accepts;	// Token type of each state
+  };
+
+  std::set<int> closure(const Nfa &nfa, std::set<int> set) {
+    std::vector<int> todo(set.begin(), set.end());
+    while(!todo.empty()) {
+      int s = todo.back();
+      todo.pop_back();
+      for(auto [cls, to] : nfa.states[s].edges)
+	if(cls < 0 && set.insert(to).second) todo.push_back(to);
+    }
+    return set;
+  }
+
+  // Subset construction, the empty set becomes the state of atoms no token can match anymore
+  Dfa determinize(const Grammar &g) {
+    Dfa dfa;
+    std::map<std::set<int>, int> ids;
+    std::vector<std::set<int>> sets;
+    auto id = [&](std::set<int> set) {
+		auto [it, added] = ids.emplace(std::move(set), static_cast<int>(sets.size()));
+		if(added) sets.push_back(it->first);
+		return it->second;
+	      };
+
+    id(closure(g.nfa, {g.start}));
+    for(std::size_t i = 0; i < sets.size(); ++i) {
+      std::vector<int> row(g.ruleClasses);
+      for(std::size_t cls = 0; cls < g.ruleClasses; ++cls) {
+	std::set<int> to;
+	for(int s : sets[i])
+	  for(auto [c, t] : g.nfa.states[s].edges)
+	    if(c == static_cast<int>(cls)) to.insert(t);
+	row[cls] = id(closure(g.nfa, to));
+      }
+
+      int token = -1;
+      for(int s : sets[i])
+	if(g.nfa.states[s].token >= 0 && (token < 0 || g.nfa.states[s].token < token)) token = g.nfa.states[s].token;
+      dfa.next.push_back(row);
+      dfa.accepts.push_back(token < 0 ? g.fallback : g.tokens[token]);
+    }
+
+    return dfa;
+  }
+
+  // Moore's partition refinement, then renumbered breadth first so the start state is 0 and the
+  // numbering only changes when the language does
+  Dfa minimize(const Dfa &dfa) {
+    std::size_t n = dfa.next.size();
+    std::vector<int> part(n);
+    std::map<std::string, int> byAccept;
+    for(std::size_t s = 0; s < n; ++s)
+      part[s] = byAccept.emplace(dfa.accepts[s], static_cast<int>(byAccept.size())).first->second;
+
+    for(std::size_t count = byAccept.size();;) {
+      std::map<std::vector<int>, int> bySignature;
+      std::vector<int> refined(n);
+      for(std::size_t s = 0; s < n; ++s) {
+	std::vector<int> sig{part[s]};
+	for(int t : dfa.next[s]) sig.push_back(part[t]);
+	refined[s] = bySignature.emplace(sig, static_cast<int>(bySignature.size())).first->second;
+      }
+      part = refined;
+      if(bySignature.size() == count) break;
+      count = bySignature.size();
+    }
+
+    std::map<int, int> order;
+    std::vector<std::size_t> rep;		// A member of each new state
+    std::queue<std::size_t> todo;
+    order[part[0]] = 0;
+    rep.push_back(0);
+    todo.push(0);
+    while(!todo.empty()) {
+      std::size_t s = todo.front();
+      todo.pop();
+      for(int t : dfa.next[s])
+	if(order.emplace(part[t], static_cast<int>(order.size())).second) {
+	  rep.push_back(t);
+	  todo.push(t);
+	}
+    }
+
+    Dfa ret;
+    for(std::size_t s : rep) {
+      std::vector<int> row;
+      for(int t : dfa.next[s]) row.push_back(order[part[t]]);
+      ret.next.push_back(row);
+      ret.accepts.push_back(dfa.accepts[s]);
+    }
+    return ret;
+  }
+
+  // Shortest atom reaching each state, for the comments of the generated tables
+  std::vector<std::string> examples(const Grammar &g, const Dfa &dfa) {
+    std::vector<char> sample(g.ruleClasses, '\0');
+    for(int c = 255; c > 0; --c)
+      if(static_cast<std::size_t>(g.classOf[c]) < g.ruleClasses && std::isgraph(c) && c != '"' && c != '\\')
+	sample[g.classOf[c]] = static_cast<char>(c);
+
+    std::vector<std::string> ret(dfa.next.size());
+    std::vector<bool> seen(dfa.next.size());
+    std::queue<int> todo;
+    seen[0] = true;
+    todo.push(0);
+    while(!todo.empty()) {
+      int s = todo.front();
+      todo.pop();
+      for(std::size_t cls = 0; cls < g.ruleClasses; ++cls) {
+	int t = dfa.next[s][cls];
+	if(!seen[t]) {
+	  seen[t] = true;
+	  ret[t] = ret[s] + sample[cls];
+	  todo.push(t);
+	}
+      }
+    }
+    return ret;
+  }
+
+  void write(std::ostream &os, const Grammar &g, const Dfa &dfa) {
+    std::size_t n = dfa.next.size();
+    if(n + ACTIONS.size() > 255) fail("too many states");
+
+    os << "// Generated by gen_dfa from atoms.grammar, do not edit\n"
+       << "// The minimal DFA classifying atoms, included in namespace lisp_reader::dfa\n\n"
+       << "// Character classes, the columns of the transition table\n"
+       << "enum Class : std::uint8_t {\n ";
+    for(const std::string &c : g.classes) os << ' ' << c << ',';
+    os << "\n  CLASSES\n};\n\n"
+       << "// States 0 to SCANNING - 1 scan an atom, from START, the others stop the scan for the character that led there\n"
+       << "enum State : std::uint8_t {\n  START = 0,\n  " << ACTION_STATES[0] << " = " << n;
+    for(std::size_t i = 1; i < ACTION_STATES.size(); ++i) os << ", " << ACTION_STATES[i];
+    os << ",\n  STATES\n};\n"
+       << "constexpr std::size_t SCANNING = " << ACTION_STATES[0] << ";\n\n"
+       << "// Class of every character\n"
+       << "inline constexpr std::uint8_t classes[256] = {";
+    for(int c = 0; c < 256; ++c) os << (c % 32 ? " " : "\n  ") << g.classOf[c] << ',';
+    os << "\n};\n\n";
+
+    std::vector<std::string> ex = examples(g, dfa);
+    os << "// transitions[state][class], each state noted with the shortest atom that reaches it\n"
+       << "inline constexpr std::uint8_t transitions[SCANNING][CLASSES] = {\n";
+    for(std::size_t s = 0; s < n; ++s) {
+      os << "  {";
+      for(std::size_t cls = 0; cls < g.classes.size(); ++cls) {
+	if(cls) os << ", ";
+	if(cls < g.ruleClasses) os << dfa.next[s][cls];
+	else os << ACTION_STATES[g.stopActions[cls - g.ruleClasses]];
+      }
+      os << "},\t// " << s << " \"" << ex[s] << "\"\n";
+    }
+    os << "};\n\n"
+       << "// What an atom ending in each state is, END when it is rejected\n"
+       << "inline constexpr TokenType accepts[SCANNING] = {";
+    for(std::size_t s = 0; s < n; ++s) os << (s % 4 ? " " : "\n  ") << "TokenType::" << dfa.accepts[s] << ',';
+    os << "\n};\n\n"
+       << "// X(n) for every scanning state n, for code with one label per state\n"
+       << "#define LISP_READER_ATOM_DFA_STATES(X)";
+    for(std::size_t s = 0; s < n; ++s) os << (s % 16 ? " " : " \\\n  ") << "X(" << s << ')';
+    os << '\n';
+  }
+} // namespace
+
+int main(int argc, char **argv) {
+  if(argc != 3) {
+    std::cerr << USAGE;
+    return 2;
+  }
+
+  grammarPath = argv[1];
+  std::ifstream in(grammarPath);
+  if(!in) fail("cannot open");
+  Grammar g = parseGrammar(in);
+  Dfa dfa = minimize(determinize(g));
+
+  std::ofstream os(argv[2]);
+  write(os, g, dfa);
+  if(!os) {
+    std::cerr << "gen_dfa: cannot write " << argv[2] << '\n';
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,344 @@
+// lispread: tokenize, validate and gather statistics over Lisp files from the command line
+// Files are memory mapped and processed in parallel, stdin is read through the buffered StreamReader path
+
+#include "reader.hpp"
+#include "mmap_reader.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using lisp_reader::StreamReader;
+using lisp_reader::StreamTokenizer;
+using lisp_reader::Tokenizer;
+using lisp_reader::Token;
+using lisp_reader::TokenType;
+using lisp_reader::ReaderLimits;
+
+namespace {
+  constexpr const char *USAGE =
+    "Usage: lispread [options] [file...]\n"
+    "Tokenizes each file, or stdin when no file (or -) is given\n"
+    "\n"
+    "Modes:\n"
+    "  --validate            Check that every file tokenizes and its parenthesis balance (default)\n"
+    "  --stats               Print a token histogram and the maximum nesting depth of each file\n"
+    "  --dump-tokens[=FMT]   Print every token, FMT is text (default) or binary\n"
+    "  --bench               Time tokenization of each file\n"
+    "\n"
+    "Options:\n"
+    "  -j N                  Process up to N files in parallel (default: number of cores)\n"
+    "  --repeat N            Tokenize each file N times in --bench mode (default: 5)\n"
+    "  --max-token-length N  Reject tokens longer than N characters\n"
+    "  --max-string-length N Reject string literals longer than N characters\n"
+    "  --max-depth N         Reject nesting deeper than N\n"
+    "  --max-tokens N        Reject inputs with more than N tokens\n"
+    "  -h, --help            Show this message\n"
+    "\n"
+    "Binary dumps are a sequence of native-endian records {uint32 type, uint32 zero, uint64 length, uint64 start},\n"
+    "where start and length locate the token in its file\n"
+    "Dumps are written as the tokens are read, one file after the other, so a file that fails to tokenize has the\n"
+    "tokens before the error dumped\n";
+
+  enum class Mode { VALIDATE, STATS, DUMP_TEXT, DUMP_BINARY, BENCH };
+
+  struct Options {
+    Mode mode = Mode::VALIDATE;
+    std::size_t jobs = 0;
+    std::size_t repeat = 5;
+    ReaderLimits limits;
+    std::vector<std::string> files;
+  };
+
+  // Binary dump record, see USAGE
+  struct DumpRecord {
+    std::uint32_t type;
+    // Spelled out so no record has uninitialized padding
+    std::uint32_t zero;
+    std::uint64_t length;
+    std::uint64_t start;
+  };
+  static_assert(sizeof(DumpRecord) == 24, "DumpRecord must match the layout in USAGE");
+  static_assert(sizeof(DumpRecord::length) >= sizeof(std::size_t),
+		"DumpRecord::length must hold the length of any token");
+
+  // Everything gathered from one input, printed in input order once all of them are done
+  struct Result {
+    bool ok = true;
+    std::string error;
+    std::size_t bytes = 0;
+    std::size_t tokens = 0;
+    std::size_t maxDepth = 0;
+    std::array<std::size_t, static_cast<int>(TokenType::END)> histogram{};
+    double seconds = 0;
+  };
+
+  // Lets the token dumps of inputs read in parallel out in the order the inputs were given
+  // Inputs are handed out in that order too, so whichever is next always has a worker on it and never waits
+  class OrderedOutput {
+  public:
+    // Blocks until every input before index is done
+    void wait(std::size_t index) {
+      std::unique_lock<std::mutex> lock(_m);
+      _cv.wait(lock, [this, index]() {return _turn == index;});
+    }
+    // Marks input index done, it has to be its turn
+    void done(std::size_t index) {
+      {
+	std::lock_guard<std::mutex> lock(_m);
+	_turn = index + 1;
+      }
+      _cv.notify_all();
+    }
+  private:
+    std::mutex _m;
+    std::condition_variable _cv;
+    std::size_t _turn = 0;
+  };
+
+  // The token dump of one input, written to stdout a buffer at a time once its turn comes
+  // Until then it waits with a full buffer, so memory stays bounded however large the input
+  class Dump {
+  public:
+    static constexpr std::streamoff BUFFER_SIZE = 1 << 16;
+
+    Dump(OrderedOutput &out, std::size_t index) : _out(out), _index(index) {}
+
+    // Where records go, call flushIfFull() after each one
+    std::ostream &stream() {return _buf;}
+    void flushIfFull() {
+      if(_buf.tellp() >= BUFFER_SIZE) _flush();
+    }
+    // Writes out the rest and lets the next input go ahead
+    void finish() {
+      _flush();
+      _out.done(_index);
+    }
+  private:
+    OrderedOutput &_out;
+    std::size_t _index;
+    std::ostringstream _buf;
+
+    void _flush() {
+      _out.wait(_index);
+      std::string data = _buf.str();
+      std::cout.write(data.data(), data.size());
+      _buf.str(std::string());
+    }
+  };
+
+  // Reads every token, filling in res according to the mode and writing dumps to dump
+  // Throws whatever the Tokenizer throws, the caller records it as an error
+  template <typename T>
+  void tokenize(Tokenizer<T> &tok, const Options &opts, Result &res, Dump *dump) {
+    while(tok.canRead()) {
+      std::size_t depth = tok.depth();
+      Token t = tok.read();
+
+      if(t.first == TokenType::CLOSE_PARENTHESIS && depth == 0)
+	throw "Unmatched close parenthesis";
+
+      ++res.histogram[static_cast<int>(t.first)];
+      res.maxDepth = std::max(res.maxDepth, tok.depth());
+
+      if(opts.mode == Mode::DUMP_TEXT) {
+	auto [start, end] = tok.span();
+	dump->stream() << start << '-' << end << ' ' << t << '\n';
+	dump->flushIfFull();
+      }
+      else if(opts.mode == Mode::DUMP_BINARY) {
+	auto [start, end] = tok.span();
+	DumpRecord rec{static_cast<std::uint32_t>(t.first), 0, end - start, start};
+	dump->stream().write(reinterpret_cast<const char *>(&rec), sizeof(rec));
+	dump->flushIfFull();
+      }
+    }
+    if(tok.depth() != 0)
+      throw "Unclosed open parenthesis at end of input";
+
+    res.tokens = tok.count();
+    res.bytes = tok.offset();
+  }
+
+  // Runs the tokenizer built by make() and records any error along with where it was found
+  template <typename F>
+  void run(F make, const Options &opts, Result &res, Dump *dump) {
+    std::size_t repeat = opts.mode == Mode::BENCH ? opts.repeat : 1;
+    auto begin = std::chrono::steady_clock::now();
+
+    for(std::size_t i = 0; i < repeat; ++i) {
+      auto tok = make();
+      res = Result{};
+      try {
+	tokenize(tok, opts, res, dump);
+      }
+      catch(const char *msg) {
+	res.ok = false;
+	res.error = std::to_string(tok.offset()) + ": " + msg;
+	return;
+      }
+      catch(const std::exception &e) {
+	res.ok = false;
+	res.error = std::to_string(tok.offset()) + ": " + e.what();
+	return;
+      }
+    }
+
+    res.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() / repeat;
+  }
+
+  Result processFile(const std::string &path, const Options &opts, Dump *dump) {
+    Result res;
+    try {
+      // Map once, every repeat tokenizes the same mapping
+      lisp_reader::MappedFile file(path);
+      std::string_view data = file.view();
+      run([&data, &opts]() {return lisp_reader::StringTokenizer(lisp_reader::StringReader(data), opts.limits);}, opts, res,
+	  dump);
+    }
+    catch(const std::system_error &e) {
+      res.ok = false;
+      res.error = e.what();
+    }
+
+    return res;
+  }
+
+  Result processStdin(const Options &opts, Dump *dump) {
+    Result res;
+    // Standard input cannot be rewound, so it is only ever read once
+    Options once = opts;
+    once.repeat = 1;
+    run([&once]() {return StreamTokenizer(StreamReader(std::cin), once.limits);}, once, res, dump);
+
+    return res;
+  }
+
+  // Prints the outcome for one input, returns whether it succeeded
+  bool report(const std::string &name, const Result &res, const Options &opts) {
+    if(!res.ok) {
+      std::cerr << name << ':' << res.error << '\n';
+      return false;
+    }
+
+    switch(opts.mode) {
+    case Mode::VALIDATE:
+      std::cout << name << ": OK\n";
+      break;
+    case Mode::STATS:
+      std::cout << name << ": " << res.bytes << " bytes, " << res.tokens << " tokens, max depth " << res.maxDepth << '\n';
+      for(int i = 0; i < static_cast<int>(TokenType::END); ++i)
+	if(res.histogram[i])
+	  std::cout << "  " << lisp_reader::getLabel(static_cast<TokenType>(i)) << ": " << res.histogram[i] << '\n';
+      break;
+    case Mode::DUMP_TEXT:
+    case Mode::DUMP_BINARY:
+      // Already written while reading
+      break;
+    case Mode::BENCH:
+      std::cout << name << ": " << res.tokens << " tokens in " << res.seconds * 1e3 << " ms, "
+		<< (res.seconds > 0 ? res.bytes / res.seconds / (1 << 20) : 0) << " MB/s\n";
+      break;
+    }
+
+    return true;
+  }
+
+  // Parses a numeric option value, exits with the usage message if it is not one
+  std::size_t parseCount(const char *opt, const char *val) {
+    char *end = nullptr;
+    unsigned long long n = val ? std::strtoull(val, &end, 10) : 0;
+    if(!val || *end != '\0') {
+      std::cerr << "lispread: " << opt << " requires a number\n" << USAGE;
+      std::exit(2);
+    }
+
+    return static_cast<std::size_t>(n);
+  }
+
+  Options parseArgs(int argc, char **argv) {
+    Options opts;
+
+    for(int i = 1; i < argc; ++i) {
+      std::string_view arg = argv[i];
+      const char *next = i + 1 < argc ? argv[i + 1] : nullptr;
+
+      if(arg == "-h" || arg == "--help") {
+	std::cout << USAGE;
+	std::exit(0);
+      }
+      else if(arg == "--validate") opts.mode = Mode::VALIDATE;
+      else if(arg == "--stats") opts.mode = Mode::STATS;
+      else if(arg == "--dump-tokens" || arg == "--dump-tokens=text") opts.mode = Mode::DUMP_TEXT;
+      else if(arg == "--dump-tokens=binary") opts.mode = Mode::DUMP_BINARY;
+      else if(arg == "--bench") opts.mode = Mode::BENCH;
+      else if(arg == "-j") opts.jobs = parseCount(argv[i++], next);
+      else if(arg == "--repeat") opts.repeat = std::max<std::size_t>(1, parseCount(argv[i++], next));
+      else if(arg == "--max-token-length") opts.limits.maxTokenLength = parseCount(argv[i++], next);
+      else if(arg == "--max-string-length") opts.limits.maxStringLength = parseCount(argv[i++], next);
+      else if(arg == "--max-depth") opts.limits.maxDepth = parseCount(argv[i++], next);
+      else if(arg == "--max-tokens") opts.limits.maxTokens = parseCount(argv[i++], next);
+      else if(arg.size() > 1 && arg[0] == '-') {
+	std::cerr << "lispread: unknown option " << arg << '\n' << USAGE;
+	std::exit(2);
+      }
+      else opts.files.emplace_back(arg);
+    }
+
+    if(opts.files.empty())
+      opts.files.emplace_back("-");
+    if(!opts.jobs)
+      opts.jobs = std::max(1u, std::thread::hardware_concurrency());
+
+    return opts;
+  }
+} // namespace
+
+int main(int argc, char **argv) {
+  std::ios::sync_with_stdio(false);
+  Options opts = parseArgs(argc, argv);
+
+  std::vector<Result> results(opts.files.size());
+  bool dumping = opts.mode == Mode::DUMP_TEXT || opts.mode == Mode::DUMP_BINARY;
+  OrderedOutput output;
+  // Files are handed out one at a time, stdin is read by whichever worker picks it up
+  std::atomic<std::size_t> next{0};
+  auto worker = [&]() {
+    for(std::size_t i; (i = next++) < opts.files.size();) {
+      Dump dump(output, i);
+      Dump *d = dumping ? &dump : nullptr;
+      results[i] = opts.files[i] == "-" ? processStdin(opts, d) : processFile(opts.files[i], opts, d);
+      if(dumping) dump.finish();
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for(std::size_t i = 1; i < std::min(opts.jobs, opts.files.size()); ++i)
+    pool.emplace_back(worker);
+  worker();
+  for(std::thread &t : pool) t.join();
+
+  // Report in the order the files were given, regardless of which finished first
+  bool ok = true;
+  Result total;
+  for(std::size_t i = 0; i < results.size(); ++i) {
+    ok &= report(opts.files[i], results[i], opts);
+    total.bytes += results[i].bytes;
+    total.tokens += results[i].tokens;
+    total.seconds += results[i].seconds;
+  }
+  if(opts.mode == Mode::BENCH && results.size() > 1)
+    report("total", total, opts);
+
+  return ok ? 0 : 1;
+}
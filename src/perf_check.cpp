@@ -0,0 +1,450 @@
+// reader_perf: the performance regression gate behind the perf_check target
+// Tokenizes generated corpora repeatedly, compares the throughput samples against a stored baseline with a
+// one-sided Mann-Whitney U test, and fails when a benchmark got significantly and noticeably slower
+// Each sample is the reader's throughput relative to a reference loop timed right before it on the same corpus,
+// so the speed and the load of the machine cancel out and a baseline recorded elsewhere still applies
+// Hardware counters are reported alongside when the machine lets us read them
+
+#include "reader.hpp"
+#include "corpus.hpp"
+#include "dfa_lexer.hpp"
+#include "perf_counters.hpp"
+#include "token_profile.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using lisp_reader::CorpusGenerator;
+using lisp_reader::CorpusOptions;
+using lisp_reader::PerfCounter;
+using lisp_reader::PerfCounters;
+using lisp_reader::PerfSample;
+using lisp_reader::TokenType;
+
+namespace {
+  constexpr const char *USAGE =
+    "Usage: reader_perf [options]\n"
+    "Benchmarks the reader on generated corpora and compares the results against a baseline\n"
+    "Throughput is compared relative to a reference loop over the same corpus, timed alongside\n"
+    "\n"
+    "Options:\n"
+    "  --baseline FILE    Baseline JSON to compare against, or to write with --update\n"
+    "  --update           Write the measured samples to the baseline instead of comparing\n"
+    "  --repeat N         Samples per benchmark (default: 9)\n"
+    "  --size N           Bytes per corpus (default: 4194304)\n"
+    "  --threshold PCT    Slowdown of the median relative throughput that counts as a regression (default: 10)\n"
+    "  --alpha P          Significance level of the Mann-Whitney test (default: 0.01)\n"
+    "  --profile          Also break the hardware counters of the mixed corpus down by token type\n"
+    "  -h, --help         Show this message\n"
+    "\n"
+    "Exits with 1 when a benchmark regressed, and 2 on usage or baseline errors\n";
+
+  struct Options {
+    std::string baseline;
+    bool update = false;
+    std::size_t repeat = 9;
+    std::size_t size = 4 << 20;
+    // Above the run to run noise of the relative throughput, which moved medians of unchanged code by up to 8.2%
+    // on a busy single core VM, while MB/s moved by up to 29%
+    double threshold = 10;
+    double alpha = 0.01;
+    bool profile = false;
+  };
+
+  // Throughput samples by benchmark name, in MB/s or in percent of the reference loop's
+  typedef std::map<std::string, std::vector<double>> Samples;
+
+  // What the baseline's samples are measured in, older baselines held MB/s and cannot be compared
+  constexpr const char *UNIT = "percent of reference";
+
+  [[noreturn]] void fail(const std::string &msg) {
+    std::cerr << "reader_perf: " << msg << '\n';
+    std::exit(2);
+  }
+
+  // The corpora every reader is run on, each stressing a different part of the tokenizer
+  std::vector<std::pair<std::string, CorpusOptions>> corpora() {
+    auto only = [](std::initializer_list<TokenType> types) {
+		  CorpusOptions opts;
+		  opts.mix.fill(0);
+		  for(TokenType t : types) opts.mix[static_cast<int>(t)] = 1;
+		  return opts;
+		};
+
+    CorpusOptions symbols = only({TokenType::SYMBOL});
+    symbols.escapeRate = 0.1;
+    CorpusOptions text = only({TokenType::STRING, TokenType::COMMENT});
+    text.maxStringLength = 200;
+    CorpusOptions nested;
+    nested.maxDepth = 64;
+    nested.nestProbability = 0.9;
+
+    return {
+      {"mixed", CorpusOptions()},
+      {"symbols", symbols},
+      {"numbers", only({TokenType::INT, TokenType::FLOAT, TokenType::DOUBLE, TokenType::FRACTION})},
+      {"text", text},
+      {"nested", nested},
+    };
+  }
+
+  template <typename T>
+  std::size_t readAll(T &&tok) {
+    std::size_t cnt = 0;
+    for(; tok.canRead(); ++cnt) tok.read();
+
+    return cnt;
+  }
+
+  // Tokenizes the corpus with the named reader
+  std::size_t tokenize(const std::string &reader, const std::string &corpus) {
+    if(reader == "string")
+      return readAll(lisp_reader::StringTokenizer(lisp_reader::StringReader(corpus)));
+    if(reader == "dfa")
+      return readAll(lisp_reader::DfaTokenizer(corpus));
+
+    std::istringstream is(corpus);
+    return readAll(lisp_reader::StreamTokenizer(lisp_reader::StreamReader(is)));
+  }
+
+  // The loop every sample is measured against, a toy lexer sharing no code with the reader
+  // It splits the corpus into runs of bytes of the same class and copies out the bytes of some classes, so like
+  // the reader it does a table lookup, a data dependent branch and a store per byte. A slower or busier machine,
+  // cache contention included, slows both, while a slower reader only shows in the ratio
+  // An arithmetic loop was tried first, but it does not feel cache contention and left the ratio as noisy as MB/s
+  class Reference {
+  public:
+    Reference() {
+      for(int i = 0; i < 256; ++i) _classes[i] = static_cast<unsigned char>((i * 37 + 11) & 3);
+    }
+
+    std::size_t run(const std::string &corpus) {
+      _out.resize(corpus.size());
+      std::size_t runs = 0, len = 0;
+      unsigned char prev = 0;
+      for(char c : corpus) {
+	unsigned char cls = _classes[static_cast<unsigned char>(c)];
+	if(cls != prev) {
+	  ++runs;
+	  prev = cls;
+	}
+	if(cls) _out[len++] = c;
+      }
+
+      return runs + len;
+    }
+  private:
+    std::array<unsigned char, 256> _classes;
+    std::string _out;
+  };
+  // Keeps the reference from being optimized away
+  volatile std::size_t referenceSink;
+
+  template <typename F>
+  double seconds(F f) {
+    auto begin = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+  }
+
+  double median(std::vector<double> v) {
+    std::sort(v.begin(), v.end());
+    std::size_t n = v.size();
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+  }
+
+  // One-sided Mann-Whitney U test, the p-value of "x tends to be smaller than y"
+  // Uses the normal approximation with tie and continuity corrections, fine from about 8 samples each
+  double mannWhitneyLess(const std::vector<double> &x, const std::vector<double> &y) {
+    std::vector<std::pair<double, bool>> all;	// (value, from x)
+    for(double v : x) all.emplace_back(v, true);
+    for(double v : y) all.emplace_back(v, false);
+    std::sort(all.begin(), all.end());
+
+    // Tied values share the average of their ranks
+    double rankSumX = 0, ties = 0;
+    for(std::size_t i = 0; i < all.size();) {
+      std::size_t j = i;
+      while(j < all.size() && all[j].first == all[i].first) ++j;
+      double rank = (i + 1 + j) / 2.0;
+      for(std::size_t k = i; k < j; ++k)
+	if(all[k].second) rankSumX += rank;
+      double t = static_cast<double>(j - i);
+      ties += t * t * t - t;
+      i = j;
+    }
+
+    double n1 = static_cast<double>(x.size()), n2 = static_cast<double>(y.size()), n = n1 + n2;
+    double u = rankSumX - n1 * (n1 + 1) / 2;
+    double sigma = std::sqrt(n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1))));
+    if(sigma == 0) return 1;
+
+    double z = (u - n1 * n2 / 2 + 0.5) / sigma;
+    return 0.5 * std::erfc(-z / std::sqrt(2.0));
+  }
+
+  // Just enough JSON for the baseline file: an object of arrays of numbers
+  // {"size": N, "unit": "...", "benchmarks": {"name": [samples...], ...}}
+  class BaselineParser {
+  public:
+    explicit BaselineParser(std::string text) : _s(std::move(text)), _i(0) {}
+
+    Samples parse(std::size_t &size, std::string &unit) {
+      Samples ret;
+      _expect('{');
+      while(!_peek('}')) {
+	std::string key = _string();
+	_expect(':');
+	if(key == "size") size = static_cast<std::size_t>(_number());
+	else if(key == "unit") unit = _string();
+	else if(key == "benchmarks") {
+	  _expect('{');
+	  while(!_peek('}')) {
+	    std::string name = _string();
+	    _expect(':');
+	    _expect('[');
+	    std::vector<double> &v = ret[name];
+	    while(!_peek(']')) {
+	      v.push_back(_number());
+	      _comma(']');
+	    }
+	    _expect(']');
+	    _comma('}');
+	  }
+	  _expect('}');
+	}
+	else fail("unknown key \"" + key + "\" in baseline");
+	_comma('}');
+      }
+      _expect('}');
+
+      return ret;
+    }
+  private:
+    std::string _s;
+    std::size_t _i;
+
+    void _space() {
+      while(_i < _s.size() && std::isspace(static_cast<unsigned char>(_s[_i]))) ++_i;
+    }
+    bool _peek(char c) {
+      _space();
+      return _i < _s.size() && _s[_i] == c;
+    }
+    void _expect(char c) {
+      if(!_peek(c)) fail(std::string("malformed baseline, expected '") + c + "' at offset " + std::to_string(_i));
+      ++_i;
+    }
+    // Skips the comma between elements, unless the container ends here
+    void _comma(char end) {
+      if(!_peek(end)) _expect(',');
+    }
+    std::string _string() {
+      _expect('"');
+      std::size_t end = _s.find('"', _i);
+      if(end == std::string::npos) fail("malformed baseline, unterminated string");
+      std::string ret = _s.substr(_i, end - _i);
+      _i = end + 1;
+      return ret;
+    }
+    double _number() {
+      _space();
+      const char *begin = _s.c_str() + _i;
+      char *end = nullptr;
+      double v = std::strtod(begin, &end);
+      if(end == begin) fail("malformed baseline, expected a number at offset " + std::to_string(_i));
+      _i += end - begin;
+      return v;
+    }
+  };
+
+  void writeBaseline(const std::string &path, const Samples &samples, std::size_t size) {
+    std::ofstream os(path);
+    os << "{\n  \"size\": " << size << ",\n  \"unit\": \"" << UNIT << "\",\n  \"benchmarks\": {";
+    for(auto it = samples.begin(); it != samples.end(); ++it) {
+      os << (it == samples.begin() ? "\n" : ",\n") << "    \"" << it->first << "\": [";
+      for(std::size_t i = 0; i < it->second.size(); ++i)
+	os << (i ? ", " : "") << std::fixed << std::setprecision(3) << it->second[i];
+      os << ']';
+    }
+    os << "\n  }\n}\n";
+    if(!os) fail("cannot write " + path);
+  }
+
+  // Per token type counters, see ProfiledTokenizer
+  void printProfile(const std::string &corpus) {
+    lisp_reader::StringTokenizer tok{lisp_reader::StringReader(corpus)};
+    lisp_reader::ProfiledTokenizer<lisp_reader::StringReader> prof(tok);
+    while(prof.canRead()) prof.read();
+
+    const lisp_reader::TokenProfile &p = prof.profile();
+    std::cout << '\n' << std::left << std::setw(18) << "token type" << std::right << std::setw(10) << "tokens"
+	      << std::setw(10) << "bytes" << std::setw(10) << "cycles/B" << std::setw(8) << "IPC"
+	      << std::setw(14) << "br-miss/token" << std::setw(12) << "L1D-miss/B" << '\n';
+    for(int i = 0; i < static_cast<int>(TokenType::END); ++i) {
+      TokenType t = static_cast<TokenType>(i);
+      auto show = [&](PerfCounter c, double v) {
+		    if(!prof.counters().has(c)) return std::string("-");
+		    std::ostringstream ss;
+		    ss << std::fixed << std::setprecision(2) << v;
+		    return ss.str();
+		  };
+      std::cout << std::left << std::setw(18) << lisp_reader::tokenTypeLabels[i] << std::right
+		<< std::setw(10) << p[t].tokens << std::setw(10) << p[t].bytes
+		<< std::setw(10) << show(PerfCounter::CYCLES, p.cyclesPerByte(t))
+		<< std::setw(8) << show(PerfCounter::INSTRUCTIONS, p.ipc(t))
+		<< std::setw(14) << show(PerfCounter::BRANCH_MISSES, p.branchMissesPerToken(t))
+		<< std::setw(12) << show(PerfCounter::L1D_MISSES, p.l1dMissesPerByte(t)) << '\n';
+    }
+  }
+
+  Options parseArgs(int argc, char **argv) {
+    Options opts;
+    for(int i = 1; i < argc; ++i) {
+      std::string_view arg = argv[i];
+      const char *next = i + 1 < argc ? argv[i + 1] : nullptr;
+      auto number = [&]() {
+		      char *end = nullptr;
+		      double v = next ? std::strtod(next, &end) : 0;
+		      if(!next || *end != '\0' || v < 0) fail(std::string(arg) + " requires a number\n" + USAGE);
+		      ++i;
+		      return v;
+		    };
+
+      if(arg == "-h" || arg == "--help") {
+	std::cout << USAGE;
+	std::exit(0);
+      }
+      else if(arg == "--baseline") {
+	if(!next) fail(std::string("--baseline requires a file\n") + USAGE);
+	opts.baseline = argv[++i];
+      }
+      else if(arg == "--update") opts.update = true;
+      else if(arg == "--repeat") opts.repeat = std::max<std::size_t>(1, static_cast<std::size_t>(number()));
+      else if(arg == "--size") opts.size = static_cast<std::size_t>(number());
+      else if(arg == "--threshold") opts.threshold = number();
+      else if(arg == "--alpha") opts.alpha = number();
+      else if(arg == "--profile") opts.profile = true;
+      else fail("unknown option " + std::string(arg) + "\n" + USAGE);
+    }
+    if(opts.update && opts.baseline.empty()) fail("--update requires --baseline");
+
+    return opts;
+  }
+} // namespace
+
+int main(int argc, char **argv) {
+  Options opts = parseArgs(argc, argv);
+
+  PerfCounters counters;
+  if(!counters.available())
+    std::cout << "Hardware counters unavailable (" << counters.error() << ")\n";
+
+  // Every benchmark runs once per round, so drift of the machine during the run spreads over all of them
+  // instead of skewing whichever came last
+  struct Benchmark {
+    std::string name, reader;
+    const std::string *corpus;
+    PerfSample counts;
+  };
+  std::vector<std::pair<std::string, CorpusOptions>> kinds = corpora();
+  std::vector<std::string> texts(kinds.size());
+  std::vector<Benchmark> benchmarks;
+  for(std::size_t i = 0; i < kinds.size(); ++i) {
+    CorpusGenerator(kinds[i].second).generate(texts[i], opts.size);
+    for(const char *reader : {"string", "dfa", "stream"})
+      benchmarks.push_back({kinds[i].first + "/" + reader, reader, &texts[i], {}});
+  }
+
+  // Warm up, and count on the side so the timed runs stay undisturbed
+  for(Benchmark &b : benchmarks) {
+    counters.start();
+    tokenize(b.reader, *b.corpus);
+    counters.stop();
+    b.counts = counters.read();
+  }
+
+  // Each sample is paired with a run of the reference just before it, so both see the machine in the same state
+  Reference reference;
+  Samples current, throughput;
+  for(std::size_t round = 0; round < opts.repeat; ++round)
+    for(const Benchmark &b : benchmarks) {
+      double ref = seconds([&]() {referenceSink = reference.run(*b.corpus);});
+      double secs = seconds([&b]() {tokenize(b.reader, *b.corpus);});
+      current[b.name].push_back(ref / secs * 100);
+      throughput[b.name].push_back(static_cast<double>(b.corpus->size()) / (1 << 20) / secs);
+    }
+
+  std::cout << std::left << std::setw(18) << "benchmark" << std::right << std::setw(10) << "MB/s"
+	    << std::setw(10) << "% of ref" << std::setw(12) << "instr/B" << std::setw(14) << "br-miss/KB"
+	    << std::setw(14) << "cache-miss/KB" << '\n';
+  for(const Benchmark &b : benchmarks) {
+    auto perByte = [&](PerfCounter c, double scale) {
+		     if(!counters.has(c)) return std::string("-");
+		     std::ostringstream ss;
+		     ss << std::fixed << std::setprecision(2) << b.counts[c] * scale / b.corpus->size();
+		     return ss.str();
+		   };
+    std::cout << std::left << std::setw(18) << b.name << std::right << std::fixed << std::setprecision(1)
+	      << std::setw(10) << median(throughput[b.name]) << std::setw(10) << std::setprecision(2)
+	      << median(current[b.name]) << std::setw(12) << perByte(PerfCounter::INSTRUCTIONS, 1)
+	      << std::setw(14) << perByte(PerfCounter::BRANCH_MISSES, 1024)
+	      << std::setw(14) << perByte(PerfCounter::CACHE_MISSES, 1024) << '\n';
+  }
+  if(opts.profile) printProfile(texts.front());
+
+  if(opts.update) {
+    writeBaseline(opts.baseline, current, opts.size);
+    std::cout << "Baseline written to " << opts.baseline << '\n';
+    return 0;
+  }
+  if(opts.baseline.empty()) return 0;
+
+  std::ifstream is(opts.baseline);
+  if(!is) {
+    std::cout << "No baseline at " << opts.baseline << ", create one with --update\n";
+    return 0;
+  }
+  std::size_t baselineSize = 0;
+  std::string baselineUnit;
+  Samples baseline = BaselineParser(std::string(std::istreambuf_iterator<char>(is), {})).parse(baselineSize,
+											       baselineUnit);
+  if(baselineUnit != UNIT)
+    fail(opts.baseline + " holds absolute throughput, which does not carry over between machines, re-create it "
+	 "with --update");
+  if(baselineSize != opts.size)
+    std::cout << "Warning: the baseline was measured on " << baselineSize << " byte corpora\n";
+
+  // A regression has to be both statistically significant and large enough to matter
+  bool regressed = false;
+  std::cout << '\n' << std::left << std::setw(18) << "benchmark" << std::right << std::setw(12) << "baseline"
+	    << std::setw(10) << "now" << std::setw(10) << "change" << std::setw(10) << "p" << '\n';
+  for(const auto &[bench, samples] : current) {
+    auto it = baseline.find(bench);
+    if(it == baseline.end() || it->second.empty()) {
+      std::cout << std::left << std::setw(18) << bench << "  not in the baseline\n";
+      continue;
+    }
+
+    double before = median(it->second), now = median(samples);
+    double change = (now / before - 1) * 100;
+    double p = mannWhitneyLess(samples, it->second);
+    bool bad = p < opts.alpha && change < -opts.threshold;
+    regressed |= bad;
+    std::cout << std::left << std::setw(18) << bench << std::right << std::fixed << std::setprecision(2)
+	      << std::setw(12) << before << std::setw(10) << now << std::setw(9) << std::showpos << change << '%'
+	      << std::noshowpos << std::setprecision(4) << std::setw(10) << p << (bad ? "  REGRESSION" : "") << '\n';
+  }
+
+  return regressed ? 1 : 0;
+}
@@ -0,0 +1,289 @@
+// The lisp_reader Python module, written against the CPython and NumPy C APIs so it builds with nothing but the
+// interpreter's headers and NumPy
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include <numpy/arrayobject.h>
+
+#include "reader.hpp"
+
+#include <cstdint>
+#include <new>
+#include <string>
+#include <vector>
+
+using lisp_reader::StringReader;
+using lisp_reader::StringTokenizer;
+using lisp_reader::TokenType;
+using lisp_reader::ReaderLimits;
+
+namespace {
+  // Tokens stored as a struct of arrays, one entry per token in each
+  struct TokenColumns {
+    std::vector<std::uint8_t> types;
+    std::vector<std::uint64_t> starts;
+    std::vector<std::uint64_t> ends;
+    // INT value, or numerator of a FRACTION
+    std::vector<std::int64_t> ints;
+    // FLOAT/DOUBLE value, or denominator of a FRACTION
+    std::vector<double> floats;
+    // Text of SYMBOL, STRING and COMMENT tokens as the tokenizer decoded it, all in one buffer
+    // Token i's text runs from textOffsets[i] to textOffsets[i + 1], empty for the other tokens
+    std::vector<std::uint8_t> text;
+    std::vector<std::uint64_t> textOffsets{0};
+  };
+
+  // A new reference, released when it goes out of scope unless release() hands it on
+  class PyRef {
+  public:
+    explicit PyRef(PyObject *obj = nullptr) : _obj(obj) {}
+    PyRef(const PyRef &) = delete;
+    PyRef &operator=(const PyRef &) = delete;
+    ~PyRef() {Py_XDECREF(_obj);}
+
+    PyObject *get() const {return _obj;}
+    PyObject *release() {
+      PyObject *ret = _obj;
+      _obj = nullptr;
+      return ret;
+    }
+    explicit operator bool() const {return _obj != nullptr;}
+  private:
+    PyObject *_obj;
+  };
+
+  template <typename V> constexpr int npyType();
+  template <> constexpr int npyType<std::uint8_t>() {return NPY_UINT8;}
+  template <> constexpr int npyType<std::uint64_t>() {return NPY_UINT64;}
+  template <> constexpr int npyType<std::int64_t>() {return NPY_INT64;}
+  template <> constexpr int npyType<double>() {return NPY_FLOAT64;}
+
+  template <typename V>
+  void freeVector(PyObject *capsule) {
+    delete static_cast<std::vector<V> *>(PyCapsule_GetPointer(capsule, nullptr));
+  }
+
+  // Hands a vector over to NumPy without copying it, the array owns it from then on
+  // Returns nullptr with the Python error set on failure
+  template <typename V>
+  PyObject *toArray(std::vector<V> &&vec) {
+    npy_intp size = static_cast<npy_intp>(vec.size());
+    // An empty vector may have no storage to point at
+    if(vec.empty())
+      return PyArray_SimpleNew(1, &size, npyType<V>());
+
+    auto *owned = new std::vector<V>(std::move(vec));
+    PyRef capsule(PyCapsule_New(owned, nullptr, freeVector<V>));
+    if(!capsule) {
+      delete owned;
+      return nullptr;
+    }
+    PyRef array(PyArray_SimpleNewFromData(1, &size, npyType<V>(), owned->data()));
+    if(!array)
+      return nullptr;
+    // Steals the capsule
+    if(PyArray_SetBaseObject(reinterpret_cast<PyArrayObject *>(array.get()), capsule.release()) < 0)
+      return nullptr;
+
+    return array.release();
+  }
+
+  // Appends each token to the columns as the tokenizer calls back, so no Token is built and text is only
+  // copied once, from the tokenizer's buffer into the text column
+  struct ColumnHandler : lisp_reader::EventHandler<ColumnHandler> {
+    ColumnHandler(const StringTokenizer &tok, TokenColumns &cols) : tok(tok), cols(cols) {}
+
+    void onOpen() {push(TokenType::OPEN_PARENTHESIS);}
+    void onClose() {push(TokenType::CLOSE_PARENTHESIS);}
+    void onSymbol(std::string_view s) {pushText(TokenType::SYMBOL, s);}
+    void onString(std::string_view s) {pushText(TokenType::STRING, s);}
+    void onComment(std::string_view s) {pushText(TokenType::COMMENT, s);}
+    void onInt(int v) {push(TokenType::INT, v);}
+    void onFloat(float v) {push(TokenType::FLOAT, 0, v);}
+    void onDouble(double v) {push(TokenType::DOUBLE, 0, v);}
+    void onFraction(const lisp_reader::Fraction &f) {push(TokenType::FRACTION, f.getNum(), f.getDen());}
+
+    void pushText(TokenType type, std::string_view s) {
+      cols.text.insert(cols.text.end(), s.begin(), s.end());
+      push(type);
+    }
+    void push(TokenType type, std::int64_t i = 0, double d = 0) {
+      auto [start, end] = tok.span();
+      cols.types.push_back(static_cast<std::uint8_t>(type));
+      cols.starts.push_back(start);
+      cols.ends.push_back(end);
+      cols.ints.push_back(i);
+      cols.floats.push_back(d);
+      cols.textOffsets.push_back(cols.text.size());
+    }
+
+    const StringTokenizer &tok;
+    TokenColumns &cols;
+  };
+
+  // Reads every token of str into columns, called without the GIL
+  // Returns the reader's error message, empty if it read the whole input
+  std::string tokenizeInto(std::string_view str, ReaderLimits limits, TokenColumns &cols) {
+    try {
+      StringTokenizer tok(StringReader(str), limits);
+      ColumnHandler handler(tok, cols);
+      tok.readEvents(handler);
+    }
+    catch(const char *msg) {
+      return msg;
+    }
+    catch(const std::exception &e) {
+      return e.what();
+    }
+
+    return {};
+  }
+
+  // Builds the dict of columns returned by tokenize(), nullptr with the Python error set on failure
+  PyObject *toDict(TokenColumns &cols) {
+    PyRef ret(PyDict_New());
+    if(!ret) return nullptr;
+
+    std::pair<const char *, PyObject *> columns[] = {
+      {"type", toArray(std::move(cols.types))},
+      {"start", toArray(std::move(cols.starts))},
+      {"end", toArray(std::move(cols.ends))},
+      {"int", toArray(std::move(cols.ints))},
+      {"float", toArray(std::move(cols.floats))},
+      {"text", toArray(std::move(cols.text))},
+      {"text_offsets", toArray(std::move(cols.textOffsets))},
+    };
+    bool ok = true;
+    for(auto &[name, array] : columns) {
+      ok = ok && array && PyDict_SetItemString(ret.get(), name, array) == 0;
+      Py_XDECREF(array);
+    }
+
+    return ok ? ret.release() : nullptr;
+  }
+
+  // Tokenizes any object exposing a contiguous byte buffer (bytes, bytearray, memoryview, mmap) without copying it
+  PyObject *tokenize(PyObject *, PyObject *args, PyObject *kwargs) {
+    static const char *keywords[] = {"buffer", "max_token_length", "max_string_length", "max_depth", "max_tokens",
+      nullptr};
+    PyObject *obj;
+    Py_ssize_t maxTokenLength = 0, maxStringLength = 0, maxDepth = 0, maxTokens = 0;
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "O|$nnnn:tokenize", const_cast<char **>(keywords), &obj,
+				    &maxTokenLength, &maxStringLength, &maxDepth, &maxTokens))
+      return nullptr;
+    if(maxTokenLength < 0 || maxStringLength < 0 || maxDepth < 0 || maxTokens < 0) {
+      PyErr_SetString(PyExc_ValueError, "tokenize() limits cannot be negative");
+      return nullptr;
+    }
+
+    ReaderLimits limits;
+    limits.maxTokenLength = maxTokenLength;
+    limits.maxStringLength = maxStringLength;
+    limits.maxDepth = maxDepth;
+    limits.maxTokens = maxTokens;
+
+    // Asks for strides so a non-contiguous view is refused with a ValueError below rather than a BufferError
+    Py_buffer view;
+    if(PyObject_GetBuffer(obj, &view, PyBUF_RECORDS_RO) < 0)
+      return nullptr;
+    if(view.ndim != 1 || view.itemsize != 1 || view.strides[0] != 1) {
+      PyBuffer_Release(&view);
+      PyErr_SetString(PyExc_ValueError, "tokenize() requires a contiguous buffer of bytes");
+      return nullptr;
+    }
+
+    std::string_view str(static_cast<const char *>(view.buf), view.len);
+    TokenColumns cols;
+    std::string error;
+    // The view keeps the buffer alive and unresized while the GIL is released
+    Py_BEGIN_ALLOW_THREADS
+    error = tokenizeInto(str, limits, cols);
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&view);
+
+    if(!error.empty()) {
+      PyErr_SetString(PyExc_ValueError, error.c_str());
+      return nullptr;
+    }
+
+    try {
+      return toDict(cols);
+    }
+    catch(const std::bad_alloc &) {
+      return PyErr_NoMemory();
+    }
+  }
+
+  // Token types, with the same values as the "type" column, as an IntEnum
+  PyObject *makeTokenType() {
+    std::pair<const char *, TokenType> values[] = {
+      {"OPEN_PARENTHESIS", TokenType::OPEN_PARENTHESIS},
+      {"CLOSE_PARENTHESIS", TokenType::CLOSE_PARENTHESIS},
+      {"SYMBOL", TokenType::SYMBOL},
+      {"COMMENT", TokenType::COMMENT},
+      {"INT", TokenType::INT},
+      {"DOUBLE", TokenType::DOUBLE},
+      {"FLOAT", TokenType::FLOAT},
+      {"FRACTION", TokenType::FRACTION},
+      {"STRING", TokenType::STRING},
+    };
+    PyRef members(PyList_New(0));
+    if(!members) return nullptr;
+    for(auto [name, type] : values) {
+      PyRef member(Py_BuildValue("(si)", name, static_cast<int>(type)));
+      if(!member || PyList_Append(members.get(), member.get()) < 0)
+	return nullptr;
+    }
+
+    PyRef enumModule(PyImport_ImportModule("enum"));
+    if(!enumModule) return nullptr;
+    PyRef intEnum(PyObject_GetAttrString(enumModule.get(), "IntEnum"));
+    if(!intEnum) return nullptr;
+    PyRef args(Py_BuildValue("(sO)", "TokenType", members.get()));
+    PyRef kwargs(Py_BuildValue("{ss}", "module", "lisp_reader"));
+    if(!args || !kwargs) return nullptr;
+
+    return PyObject_Call(intEnum.get(), args.get(), kwargs.get());
+  }
+
+  PyMethodDef methods[] = {
+    {"tokenize", reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(tokenize)), METH_VARARGS | METH_KEYWORDS,
+     "tokenize(buffer, *, max_token_length=0, max_string_length=0, max_depth=0, max_tokens=0)\n"
+     "--\n"
+     "\n"
+     "Tokenizes a bytes-like object without copying it.\n"
+     "\n"
+     "Returns a dict of NumPy arrays with one entry per token, except for text and text_offsets:\n"
+     "  type:  uint8 TokenType\n"
+     "  start, end: uint64 byte offsets of the token in the input, which slice it as written: strings with their\n"
+     "         quotes, comments with their semicolons, the spaces after them and the newline ending them, |escaped|\n"
+     "         and backslashed symbols with their bars and backslashes\n"
+     "  int:   int64 value of INT tokens, numerator of FRACTION tokens\n"
+     "  float: float64 value of FLOAT and DOUBLE tokens, denominator of FRACTION tokens\n"
+     "  text, text_offsets: uint8 text of SYMBOL, STRING and COMMENT tokens as the reader decoded it, without\n"
+     "         the quotes, semicolons and escapes, token i's being text[text_offsets[i]:text_offsets[i + 1]]\n"
+     "         text_offsets has one entry more than there are tokens, the text of other tokens is empty\n"
+     "\n"
+     "Limits of 0 are unlimited. Raises ValueError on malformed input or when a limit is exceeded."},
+    {nullptr, nullptr, 0, nullptr}
+  };
+
+  PyModuleDef module = {
+    PyModuleDef_HEAD_INIT, "lisp_reader", "Bulk tokenization of Lisp source into NumPy arrays", -1, methods,
+    nullptr, nullptr, nullptr, nullptr
+  };
+} // namespace
+
+PyMODINIT_FUNC PyInit_lisp_reader() {
+  import_array();
+
+  PyRef m(PyModule_Create(&module));
+  if(!m) return nullptr;
+  PyRef tokenType(makeTokenType());
+  // Steals the reference on success only
+  if(!tokenType || PyModule_AddObject(m.get(), "TokenType", tokenType.get()) < 0)
+    return nullptr;
+  tokenType.release();
+
+  return m.release();
+}
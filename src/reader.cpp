@@ -0,0 +1,7 @@
+#include "reader.hpp"
+
+namespace lisp_reader {
+  // Explicit instantiations of the Tokenizer for the stock readers, declared extern in reader.hpp
+  template class Tokenizer<StringReader>;
+  template class Tokenizer<StreamReader>;
+} // lisp_reader
@@ -0,0 +1,111 @@
+#include "catch2/catch.hpp"
+
+#include "lisp_reader.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Helper methods
+// Owns a tokenizer along with the buffers of a batch
+struct BatchReader {
+  BatchReader(std::string_view str, std::size_t tokens, std::size_t text, const lr_limits *limits = nullptr)
+    : tok(lr_tokenizer_new(str.data(), str.size(), limits)), tokenBuf(tokens), textBuf(text) {
+    batch.tokens = tokenBuf.data();
+    batch.token_capacity = tokenBuf.size();
+    batch.text = textBuf.data();
+    batch.text_capacity = textBuf.size();
+  }
+  ~BatchReader() {lr_free(tok);}
+
+  lr_status next() {return lr_next_token_batch(tok, &batch);}
+  std::string_view text(const lr_token &t) const {return std::string_view(batch.text + t.value.text_offset, t.length);}
+
+  lr_tokenizer *tok;
+  std::vector<lr_token> tokenBuf;
+  std::vector<char> textBuf;
+  lr_batch batch{};
+};
+
+
+TEST_CASE("C API reads tokens in batches", "[c_api]") {
+  BatchReader r("(abc 12 1.5 2d1 3/4 \"str\" ;cmt", 4, 64);
+
+  REQUIRE(r.next() == LR_OK);
+  REQUIRE(r.batch.token_count == 4);
+  REQUIRE(r.batch.tokens[0].type == LR_OPEN_PARENTHESIS);
+  REQUIRE(r.batch.tokens[1].type == LR_SYMBOL);
+  REQUIRE(r.text(r.batch.tokens[1]) == "abc");
+  REQUIRE(r.batch.tokens[2].type == LR_INT);
+  REQUIRE(r.batch.tokens[2].value.i == 12);
+  REQUIRE(r.batch.tokens[3].type == LR_FLOAT);
+  REQUIRE(r.batch.tokens[3].value.d == 1.5);
+
+  REQUIRE(r.next() == LR_OK);
+  REQUIRE(r.batch.token_count == 4);
+  REQUIRE(r.batch.tokens[0].type == LR_DOUBLE);
+  REQUIRE(r.batch.tokens[0].value.d == 20.0);
+  REQUIRE(r.batch.tokens[1].type == LR_FRACTION);
+  REQUIRE(r.batch.tokens[1].value.frac.num == 3);
+  REQUIRE(r.batch.tokens[1].value.frac.den == 4);
+  REQUIRE(r.batch.tokens[2].type == LR_STRING);
+  REQUIRE(r.text(r.batch.tokens[2]) == "str");
+  REQUIRE(r.batch.tokens[3].type == LR_COMMENT);
+  REQUIRE(r.text(r.batch.tokens[3]) == "cmt");
+
+  REQUIRE(r.next() == LR_END);
+  REQUIRE(r.batch.token_count == 0);
+}
+
+TEST_CASE("C API carries tokens over when the text buffer fills", "[c_api]") {
+  BatchReader r("abc defg", 8, 4);
+
+  REQUIRE(r.next() == LR_OK);
+  REQUIRE(r.batch.token_count == 1);
+  REQUIRE(r.text(r.batch.tokens[0]) == "abc");
+  REQUIRE(r.next() == LR_OK);
+  REQUIRE(r.batch.token_count == 1);
+  REQUIRE(r.text(r.batch.tokens[0]) == "defg");
+  REQUIRE(r.next() == LR_END);
+
+  BatchReader small("abcdef", 8, 4);
+  REQUIRE(small.next() == LR_TEXT_TOO_SMALL);
+}
+
+TEST_CASE("C API rejects batches that cannot hold a token", "[c_api]") {
+  BatchReader r("abc", 0, 64);
+  REQUIRE(r.next() == LR_INVALID_ARGUMENT);
+
+  // Nothing was read, the same tokenizer still works with a usable batch
+  lr_token token;
+  r.batch.tokens = &token;
+  r.batch.token_capacity = 1;
+  r.batch.text = nullptr;
+  REQUIRE(r.next() == LR_INVALID_ARGUMENT);
+  r.batch.text = r.textBuf.data();
+  REQUIRE(r.next() == LR_OK);
+  REQUIRE(r.text(token) == "abc");
+  REQUIRE(lr_next_token_batch(r.tok, nullptr) == LR_INVALID_ARGUMENT);
+}
+
+TEST_CASE("C API reports errors after the tokens read before them", "[c_api]") {
+  lr_limits limits{};
+  limits.max_depth = 1;
+  BatchReader r("(a) ((b))", 16, 16, &limits);
+
+  REQUIRE(r.next() == LR_OK);
+  REQUIRE(r.batch.token_count == 4);
+  REQUIRE(r.next() == LR_ERROR);
+  REQUIRE(std::string_view(lr_error(r.tok)).find("DEPTH") != std::string_view::npos);
+  REQUIRE(r.next() == LR_ERROR);
+}
+
+TEST_CASE("C API reports fractions with a zero denominator as errors", "[c_api]") {
+  for(const char *str : {"(0/0)", "1/0"}) {
+    BatchReader r(str, 16, 16);
+    REQUIRE(r.next() != LR_END);
+    while(r.batch.token_count) r.next();
+    REQUIRE(r.next() == LR_ERROR);
+    REQUIRE(std::string_view(lr_error(r.tok)) == "Fraction with zero denominator");
+  }
+}
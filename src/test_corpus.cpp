@@ -0,0 +1,70 @@
+#include "catch2/catch.hpp"
+
+#include "corpus.hpp"
+
+#include <algorithm>
+#include <array>
+#include <string>
+
+using lisp_reader::CorpusGenerator;
+using lisp_reader::CorpusOptions;
+using lisp_reader::StringTokenizer;
+using lisp_reader::TokenType;
+
+// Helper methods
+std::string generate(const CorpusOptions &opts, std::size_t size) {
+  CorpusGenerator gen(opts);
+  std::string out;
+  gen.generate(out, size);
+
+  return out;
+}
+
+
+TEST_CASE("Generated corpora are reproducible", "[corpus]") {
+  CorpusOptions opts;
+  REQUIRE(generate(opts, 1 << 16) == generate(opts, 1 << 16));
+
+  // Generating in pieces gives the same bytes as all at once
+  CorpusGenerator gen(opts);
+  std::string pieces;
+  for(int i = 0; i < 16; ++i) gen.generate(pieces, 1 << 12);
+  std::string whole = generate(opts, pieces.size());
+  REQUIRE(whole.substr(0, pieces.size()) == pieces);
+
+  opts.seed = 2;
+  REQUIRE(generate(opts, 1 << 16) != generate(CorpusOptions(), 1 << 16));
+}
+
+TEST_CASE("Generated corpora tokenize and follow the requested shape", "[corpus]") {
+  CorpusOptions opts;
+  opts.maxDepth = 5;
+  opts.nestProbability = 0.9;
+  opts.escapeRate = 0.2;
+  std::string corpus = generate(opts, 1 << 20);
+  REQUIRE(corpus.size() >= (1 << 20));
+
+  std::array<std::size_t, static_cast<int>(TokenType::END)> counts{};
+  std::size_t maxDepth = 0;
+  StringTokenizer tok(corpus);
+  while(tok.canRead()) {
+    ++counts[static_cast<int>(tok.read().first)];
+    maxDepth = std::max(maxDepth, tok.depth());
+  }
+  REQUIRE(tok.depth() == 0);
+  REQUIRE(maxDepth == 5);
+  for(std::size_t count : counts) REQUIRE(count > 0);
+
+  // Only the weighted atoms show up
+  opts.mix.fill(0);
+  opts.mix[static_cast<int>(TokenType::INT)] = 1;
+  corpus = generate(opts, 1 << 14);
+  StringTokenizer ints(corpus);
+  while(ints.canRead()) {
+    TokenType t = ints.read().first;
+    REQUIRE((t == TokenType::INT || t == TokenType::OPEN_PARENTHESIS || t == TokenType::CLOSE_PARENTHESIS));
+  }
+
+  opts.mix.fill(0);
+  REQUIRE_THROWS_AS(CorpusGenerator(opts), std::invalid_argument);
+}
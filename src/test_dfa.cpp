@@ -0,0 +1,174 @@
+#include "catch2/catch.hpp"
+
+#include "dfa_lexer.hpp"
+#include "corpus.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <string>
+
+using lisp_reader::DfaTokenizer;
+using lisp_reader::ReaderLimits;
+using lisp_reader::StringReader;
+using lisp_reader::StringTokenizer;
+
+// Helper methods
+// Every token with its span, then the error if reading failed, as text to compare
+template <typename T>
+std::string lex(T &&tok) {
+  std::ostringstream os;
+  try {
+    while(tok.canRead()) {
+      os << tok.read();
+      os << " [" << tok.span().first << ", " << tok.span().second << ")\n";
+    }
+  }
+  catch(const char *e) {
+    os << "error: " << e;
+  }
+  catch(const std::exception &e) {
+    os << "error: " << e.what();
+  }
+
+  return os.str();
+}
+
+std::string lexTokenizer(const std::string &str, ReaderLimits limits = {}) {
+  return lex(StringTokenizer(StringReader(str), limits));
+}
+
+std::string lexDfa(const std::string &str, ReaderLimits limits = {}) {
+  return lex(DfaTokenizer(str, limits));
+}
+
+
+TEST_CASE("The DFA reads every short input like the state machine", "[dfa]") {
+  // Everything that moves the state machine, plus escapes, delimiters and an illegal character
+  constexpr std::string_view ALPHABET = "1+-.ed/a\\| ;\"'";
+  std::string str;
+  for(std::size_t len = 1; len <= 4; ++len) {
+    std::size_t total = 1;
+    for(std::size_t i = 0; i < len; ++i) total *= ALPHABET.size();
+
+    str.resize(len);
+    for(std::size_t n = 0; n < total; ++n) {
+      for(std::size_t i = 0, k = n; i < len; ++i, k /= ALPHABET.size()) str[i] = ALPHABET[k % ALPHABET.size()];
+      INFO(str);
+      REQUIRE(lexDfa(str) == lexTokenizer(str));
+    }
+  }
+}
+
+TEST_CASE("The DFA reads numbers like the state machine", "[dfa]") {
+  for(const char *str : {"123", "-5", "+.5", "1.", "1.e5", ".e5", "1.5d-3", "1e+", "1/2", "4/2", "1/-2", "1/2/3",
+			 "0/0", "1/0", "1.5e5.", "99999999999", "1e99999", "1d99999", "-1/0x", "...", ".", "\\.", "|..|",
+			 "\\", "|abc", "|", "a|", "a'b", "abc\\", "\"open", "; x\n1"})
+    {
+      INFO(str);
+      REQUIRE(lexDfa(str) == lexTokenizer(str));
+    }
+}
+
+TEST_CASE("The DFA reads exponents without mantissa digits as symbols", "[dfa]") {
+  for(const char *str : {".e5", ".d5", "+.e5", "-.d5", ".e", "."}) {
+    INFO(str);
+    if(std::string_view(str) == ".") {
+      REQUIRE(lexDfa(str) == "error: Too many dots");
+      continue;
+    }
+    std::string expected = "SYMBOL: " + std::string(str) + " [0, " + std::to_string(std::strlen(str)) + ")\n";
+    REQUIRE(lexTokenizer(str) == expected);
+    REQUIRE(lexDfa(str) == expected);
+  }
+}
+
+TEST_CASE("The DFA reads generated corpora like the state machine", "[dfa]") {
+  lisp_reader::CorpusOptions opts;
+  opts.escapeRate = 0.3;
+  for(std::uint64_t seed = 1; seed <= 4; ++seed) {
+    opts.seed = seed;
+    std::string corpus;
+    lisp_reader::CorpusGenerator(opts).generate(corpus, 1 << 16);
+    REQUIRE(lexDfa(corpus) == lexTokenizer(corpus));
+  }
+}
+
+TEST_CASE("The DFA enforces limits like the state machine", "[dfa]") {
+  const std::string inputs[] = {
+    "(a (b (c)))", "abcdefgh", "\"abcdefgh\"", "; abcdefgh", "abc\\ defgh", "|abcdefgh|", "abcdefgh'",
+    "\"abcdefghijklmnopqrstuvwxyz0123456789", "abcdefghijklmnopqrstuvwxyz0123456789'", "a b c d e f",
+    std::string(100, 'a') + "\\", "........"
+  };
+  for(std::size_t max : {1, 4, 8, 30, 64}) {
+    ReaderLimits byToken, byString, byDepth, byCount;
+    byToken.maxTokenLength = max;
+    byString.maxStringLength = max;
+    byDepth.maxDepth = max / 4;
+    byCount.maxTokens = max / 2;
+
+    for(const std::string &str : inputs)
+      for(const ReaderLimits &limits : {byToken, byString, byDepth, byCount}) {
+	INFO(str << " limited to " << max);
+	REQUIRE(lexDfa(str, limits) == lexTokenizer(str, limits));
+      }
+  }
+}
+
+TEST_CASE("The DFA shares checkpoints with the state machine", "[dfa]") {
+  const std::string content = "(a (b |c d| 1.5) ; note\n \"s\") x";
+  StringTokenizer tok(content);
+
+  for(std::size_t at = 0; tok.canRead(); ++at, tok.read()) {
+    lisp_reader::Checkpoint cp = tok.checkpoint();
+    DfaTokenizer dfa(content);
+    dfa.restore(cp);
+    REQUIRE(dfa.count() == at);
+    REQUIRE(dfa.depth() == tok.depth());
+
+    StringTokenizer rest(content);
+    rest.restore(cp);
+    std::string expected = lex(rest);
+    REQUIRE(lex(dfa) == expected);
+    REQUIRE(dfa.checkpoint().offset == content.size());
+
+    // And back again
+    dfa.restore(cp);
+    REQUIRE(lex(dfa) == expected);
+  }
+}
+
+TEST_CASE("The generated atom DFA only stops on stop characters", "[dfa]") {
+  using namespace lisp_reader::dfa;
+  for(std::size_t s = 0; s < SCANNING; ++s)
+    for(std::size_t cls = 0; cls < CLASSES; ++cls) {
+      INFO("state " << s << ", class " << cls);
+      bool stop = cls == SPACE || cls == DELIMITER || cls == BACKSLASH || cls == PIPE || cls == RESERVED;
+      REQUIRE((transitions[s][cls] >= SCANNING) == stop);
+    }
+
+  // Delimiters end atoms rather than being part of them
+  for(char c : {' ', '\n', '(', ')', '"', ';'})
+    REQUIRE(transitions[START][classes[static_cast<unsigned char>(c)]] == END_ATOM);
+
+  // Exactly whitespace and the characters read() starts other tokens with end atoms, and the rest of the
+  // reserved characters escape or are illegal, as checked at compile time too
+  REQUIRE(lisp_reader::detail::atomStopsMatch());
+  for(int i = 0; i < 256; ++i) {
+    char c = static_cast<char>(i);
+    INFO("character " << i);
+    bool reserved = std::find(lisp_reader::RESERVED_SYM_CHARS.begin(), lisp_reader::RESERVED_SYM_CHARS.end(), c)
+      != lisp_reader::RESERVED_SYM_CHARS.end();
+    bool delimiter = lisp_reader::detail::isSpace(c) || c == '(' || c == ')' || c == '"' || c == ';';
+    REQUIRE((stopAction(c) == END_ATOM) == delimiter);
+    REQUIRE((stopAction(c) >= SCANNING) == (delimiter || reserved));
+  }
+}
+
+TEST_CASE("The DFA rejects unclosed escapes like the state machine", "[dfa]") {
+  for(const char *str : {"|", "a|", "|abc", "(a b|"}) {
+    INFO(str);
+    REQUIRE(lexDfa(str).find("error: Unclosed pipe character found") != std::string::npos);
+    REQUIRE(lexDfa(str) == lexTokenizer(str));
+  }
+}
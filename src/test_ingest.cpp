@@ -0,0 +1,282 @@
+#include "catch2/catch.hpp"
+
+#include "ingest.hpp"
+#include "split.hpp"
+#include "spsc_ring.hpp"
+#include "thread_pool.hpp"
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using lisp_reader::StringTokenizer;
+using lisp_reader::Token;
+using lisp_reader::TokenType;
+
+// Helper methods
+// Tokenizes the whole input, returning every token
+std::vector<Token> readAll(std::string_view str) {
+  StringTokenizer tok(str);
+  std::vector<Token> tokens;
+  while(tok.canRead()) tokens.push_back(tok.read());
+
+  return tokens;
+}
+
+
+TEST_CASE("Work-stealing pool runs every task, including spawned ones", "[ingest]") {
+  std::atomic<int> cnt{0};
+  {
+    lisp_reader::WorkStealingPool pool(4);
+    for(int i = 0; i < 100; ++i)
+      pool.submit([&]() {
+		    ++cnt;
+		    for(int j = 0; j < 10; ++j) pool.submit([&]() {++cnt;});
+		  });
+    pool.wait();
+    REQUIRE(cnt == 1100);
+  }
+}
+
+TEST_CASE("SPSC ring hands every item over in order", "[ingest]") {
+  lisp_reader::SpscRing<std::size_t> ring(5);
+  REQUIRE(ring.capacity() == 8);
+  REQUIRE(ring.front() == nullptr);
+  for(std::size_t i = 0; i < 8; ++i) {
+    REQUIRE(ring.back() != nullptr);
+    *ring.back() = i;
+    ring.push();
+  }
+  REQUIRE(ring.back() == nullptr);
+  for(std::size_t i = 0; i < 8; ++i) {
+    REQUIRE(*ring.front() == i);
+    ring.pop();
+  }
+
+  constexpr std::size_t N = 200000;
+  std::thread producer([&]() {
+			 for(std::size_t i = 0; i < N; ++i) {
+			   std::size_t *slot;
+			   while(!(slot = ring.back())) std::this_thread::yield();
+			   *slot = i;
+			   ring.push();
+			 }
+		       });
+  std::size_t expected = 0;
+  while(expected < N) {
+    std::size_t *slot = ring.front();
+    if(!slot) {
+      std::this_thread::yield();
+      continue;
+    }
+    REQUIRE(*slot == expected++);
+    ring.pop();
+  }
+  producer.join();
+  REQUIRE(ring.front() == nullptr);
+}
+
+TEST_CASE("Split points never change the tokens read", "[ingest]") {
+  std::string str;
+  for(int i = 0; i < 200; ++i)
+    str += "(a \"b c\" ; d e\n |f g| h\\ i 1.5)\n";
+
+  auto points = lisp_reader::findSplitPoints(str, 64);
+  REQUIRE(points.size() > 10);
+  REQUIRE(points[0].offset == 0);
+
+  std::vector<Token> split;
+  for(std::size_t i = 0; i < points.size(); ++i) {
+    std::size_t end = i + 1 < points.size() ? points[i + 1].offset : str.size();
+    for(Token &t : readAll(std::string_view(str).substr(points[i].offset, end - points[i].offset)))
+      split.push_back(std::move(t));
+  }
+  REQUIRE(split == readAll(str));
+}
+
+TEST_CASE("Split points follow the escapes of the grammar", "[ingest]") {
+  // Every short input over the characters that decide where atoms end, with the escapes the grammar has
+  std::string alphabet = "()\"; \na";
+  for(int c = 0; c < 256; ++c)
+    if(lisp_reader::dfa::stopAction(static_cast<char>(c)) == lisp_reader::dfa::ESCAPE)
+      alphabet += static_cast<char>(c);
+
+  std::size_t compared = 0;
+  std::string str;
+  for(std::size_t len = 1; len <= 5; ++len) {
+    std::size_t total = 1;
+    for(std::size_t i = 0; i < len; ++i) total *= alphabet.size();
+    str.resize(len);
+    for(std::size_t n = 0; n < total; ++n) {
+      for(std::size_t i = 0, k = n; i < len; ++i, k /= alphabet.size()) str[i] = alphabet[k % alphabet.size()];
+
+      // Every token with where it starts and the depth before it, for the inputs that tokenize
+      std::vector<std::pair<std::size_t, Token>> all;
+      std::vector<std::size_t> depths;
+      try {
+	StringTokenizer tok(str);
+	while(tok.canRead()) {
+	  depths.push_back(tok.depth());
+	  Token t = tok.read();
+	  all.emplace_back(tok.span().first, std::move(t));
+	}
+      }
+      catch(...) {
+	continue;
+      }
+      ++compared;
+
+      INFO(str);
+      lisp_reader::detail::walkSafePoints(str, {0, 0}, [&](lisp_reader::SplitPoint p) {
+	  std::size_t first = 0;
+	  while(first < all.size() && all[first].first < p.offset) ++first;
+	  StringTokenizer resumed(str);
+	  resumed.restore({p.offset, p.depth, 0});
+	  for(std::size_t i = first; i < all.size(); ++i) {
+	    REQUIRE(resumed.depth() == depths[i]);
+	    REQUIRE(resumed.read() == all[i].second);
+	  }
+	  REQUIRE(!resumed.canRead());
+	  return false;
+	});
+    }
+  }
+  REQUIRE(compared > 1000);
+}
+
+TEST_CASE("Finds safe points from arbitrary offsets", "[ingest]") {
+  std::string str;
+  for(int i = 0; i < 20; ++i)
+    str += "(defun f (a) \"b (c\" ; d (e\n  |f (g| h\\ i\n  (j 1.5))\n";
+
+  // Every token with where it starts and the depth before it
+  std::vector<std::pair<std::size_t, Token>> all;
+  std::vector<std::size_t> depths;
+  StringTokenizer tok(str);
+  while(tok.canRead()) {
+    depths.push_back(tok.depth());
+    Token t = tok.read();
+    all.emplace_back(tok.span().first, std::move(t));
+  }
+
+  std::vector<lisp_reader::SplitPoint> index = lisp_reader::findSplitPoints(str, 100);
+  REQUIRE(index.size() > 5);
+  for(std::size_t offset = 0; offset <= str.size(); ++offset) {
+    INFO("offset " << offset);
+    // Forms start in the first column here, so the guess is right too
+    for(lisp_reader::SplitPoint p : {lisp_reader::guessSafePoint(str, offset),
+				     lisp_reader::nextSafePoint(str, {0, 0}, offset),
+				     lisp_reader::nextSafePoint(str, index, offset)}) {
+      REQUIRE(p.offset >= offset);
+
+      std::size_t first = 0;
+      while(first < all.size() && all[first].first < p.offset) ++first;
+      StringTokenizer resumed(str);
+      resumed.restore({p.offset, p.depth, 0});
+      for(std::size_t i = first; i < all.size(); ++i) {
+	REQUIRE(resumed.depth() == depths[i]);
+	REQUIRE(resumed.read() == all[i].second);
+      }
+      REQUIRE(!resumed.canRead());
+    }
+  }
+
+  // An open parenthesis in the first column inside a string fools the guess, but not a walk from a known point
+  std::string tricky = "(a \"b\n(c d\" e)";
+  lisp_reader::SplitPoint guess = lisp_reader::guessSafePoint(tricky, 7);
+  REQUIRE(guess.offset == 8);
+  // Tokenizing from the guess starts inside the string, reading d and then an unclosed one
+  StringTokenizer fooled(tricky);
+  fooled.restore({guess.offset, guess.depth, 0});
+  REQUIRE(fooled.read() == Token{TokenType::SYMBOL, std::string("d")});
+  REQUIRE_THROWS_WITH(fooled.read(), "Missing closing double-quotes for string literal");
+  REQUIRE(lisp_reader::nextSafePoint(tricky, {0, 0}, 7).offset == 11);
+  REQUIRE(lisp_reader::nextSafePoint(tricky, std::vector<lisp_reader::SplitPoint>{{2, 1}}, 7).offset == 11);
+  REQUIRE(lisp_reader::nextSafePoint(tricky, std::vector<lisp_reader::SplitPoint>{}, 7).offset == 11);
+}
+
+TEST_CASE("Ingests files in order, splitting the large ones", "[ingest]") {
+  auto dir = std::filesystem::temp_directory_path() / "cpplispreader_ingest_test";
+  std::filesystem::create_directories(dir);
+
+  std::vector<std::string> paths;
+  std::vector<std::size_t> expected;
+  for(int i = 0; i < 20; ++i) {
+    std::string content;
+    // Every tenth file is much larger than the chunk size
+    for(int j = 0; j < (i % 10 == 0 ? 2000 : 3); ++j)
+      content += "(x " + std::to_string(j) + " \"s\")\n";
+
+    paths.push_back((dir / ("f" + std::to_string(i) + ".lisp")).string());
+    std::ofstream(paths.back()) << content;
+    expected.push_back(readAll(content).size());
+  }
+  paths.push_back((dir / "missing.lisp").string());
+
+  lisp_reader::IngestOptions opts;
+  opts.threads = 4;
+  opts.chunkSize = 1024;
+  auto results = lisp_reader::ingest(paths, [](StringTokenizer &tok, const lisp_reader::Chunk &) {
+				       std::size_t cnt = 0;
+				       for(; tok.canRead(); ++cnt) tok.read();
+				       return cnt;
+				     }, opts);
+
+  REQUIRE(results.size() == paths.size());
+  for(std::size_t i = 0; i < expected.size(); ++i) {
+    REQUIRE(results[i].path == paths[i]);
+    REQUIRE(results[i].ok());
+    REQUIRE((results[i].chunks.size() > 1) == (i % 10 == 0));
+
+    std::size_t cnt = 0;
+    for(const auto &chunk : results[i].chunks) cnt += chunk.value;
+    REQUIRE(cnt == expected[i]);
+  }
+  REQUIRE(!results.back().ok());
+  REQUIRE(!results.back().error.empty());
+
+  std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Ingested chunks keep the depth and offsets of the whole file", "[ingest]") {
+  auto dir = std::filesystem::temp_directory_path() / "cpplispreader_ingest_depth_test";
+  std::filesystem::create_directories(dir);
+
+  // Nested 8 deep around most of the file, then 4 deeper in a later chunk
+  std::string content(8, '(');
+  for(int j = 0; j < 200; ++j) content += "x " + std::to_string(j) + "\n";
+  content += "((((y))))" + std::string(8, ')') + "\n";
+  std::string path = (dir / "deep.lisp").string();
+  std::ofstream(path) << content;
+
+  lisp_reader::IngestOptions opts;
+  opts.threads = 2;
+  opts.chunkSize = 256;
+  // Counts the tokens whose span is not where they are in the chunk
+  auto misplaced = [](StringTokenizer &tok, const lisp_reader::Chunk &chunk) {
+		     std::size_t cnt = 0;
+		     while(tok.canRead()) {
+		       tok.read();
+		       auto [start, end] = tok.span();
+		       if(start < chunk.offset || end > chunk.offset + chunk.data.size() || chunk.data[start - chunk.offset] == ' ')
+			 ++cnt;
+		     }
+		     return cnt;
+		   };
+
+  auto results = lisp_reader::ingest({path}, misplaced, opts);
+  REQUIRE(results[0].ok());
+  for(const auto &chunk : results[0].chunks) REQUIRE(chunk.value == 0);
+  REQUIRE(results[0].chunks.size() > 1);
+
+  opts.limits.maxDepth = 10;
+  results = lisp_reader::ingest({path}, misplaced, opts);
+  REQUIRE(!results[0].ok());
+  REQUIRE(results[0].chunks.front().ok());
+  REQUIRE(!results[0].chunks.back().ok());
+
+  std::filesystem::remove_all(dir);
+}
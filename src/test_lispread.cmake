@@ -0,0 +1,169 @@
+# Tests of the lispread command-line tool, run by ctest as lispread_test
+# Writes its fixtures to WORK_DIR, then runs LISPREAD over them and checks the output and exit code of each run
+#   cmake -DLISPREAD=<path to lispread> -DWORK_DIR=<scratch directory> -P test_lispread.cmake
+cmake_minimum_required(VERSION 3.15)
+
+if(NOT LISPREAD OR NOT WORK_DIR)
+  message(FATAL_ERROR "Usage: cmake -DLISPREAD=<lispread> -DWORK_DIR=<scratch directory> -P test_lispread.cmake")
+endif()
+
+# Helper methods
+
+# Runs lispread with ARGS in WORK_DIR and checks what it did, a failed check fails the test but the others still run
+#   EXIT code              exit code it must return
+#   STDOUT text            exact output, or STDOUT_MATCHES regex
+#   STDERR text            exact error output, or STDERR_MATCHES regex
+#                          Empty arguments are dropped on the way in, so empty output is matched with "^$"
+#   INPUT file             fixture fed to stdin
+#   OUTPUT_FILE file       where stdout goes instead, for binary output
+function(run name)
+  cmake_parse_arguments(T "" "EXIT;STDOUT;STDOUT_MATCHES;STDERR;STDERR_MATCHES;INPUT;OUTPUT_FILE" "ARGS" ${ARGN})
+
+  set(io)
+  if(DEFINED T_INPUT)
+    list(APPEND io INPUT_FILE ${WORK_DIR}/${T_INPUT})
+  endif()
+  if(DEFINED T_OUTPUT_FILE)
+    list(APPEND io OUTPUT_FILE ${WORK_DIR}/${T_OUTPUT_FILE})
+  else()
+    list(APPEND io OUTPUT_VARIABLE out)
+  endif()
+  execute_process(COMMAND ${LISPREAD} ${T_ARGS} WORKING_DIRECTORY ${WORK_DIR} ${io}
+    ERROR_VARIABLE err RESULT_VARIABLE rc)
+
+  if(NOT "${rc}" STREQUAL "${T_EXIT}")
+    message(SEND_ERROR "${name}: exited with ${rc} instead of ${T_EXIT}\n${err}")
+  endif()
+  if(DEFINED T_STDOUT AND NOT "${out}" STREQUAL "${T_STDOUT}")
+    message(SEND_ERROR "${name}: wrote\n${out}\ninstead of\n${T_STDOUT}")
+  endif()
+  if(DEFINED T_STDOUT_MATCHES AND NOT "${out}" MATCHES "${T_STDOUT_MATCHES}")
+    message(SEND_ERROR "${name}: wrote\n${out}\nwhich does not match ${T_STDOUT_MATCHES}")
+  endif()
+  if(DEFINED T_STDERR AND NOT "${err}" STREQUAL "${T_STDERR}")
+    message(SEND_ERROR "${name}: wrote to stderr\n${err}\ninstead of\n${T_STDERR}")
+  endif()
+  if(DEFINED T_STDERR_MATCHES AND NOT "${err}" MATCHES "${T_STDERR_MATCHES}")
+    message(SEND_ERROR "${name}: wrote to stderr\n${err}\nwhich does not match ${T_STDERR_MATCHES}")
+  endif()
+endfunction()
+
+# Sets var to what lispread writes to stdout with args, checking that it succeeds
+function(output_of var)
+  execute_process(COMMAND ${LISPREAD} ${ARGN} WORKING_DIRECTORY ${WORK_DIR} OUTPUT_VARIABLE out RESULT_VARIABLE rc)
+  if(NOT rc EQUAL 0)
+    message(SEND_ERROR "lispread ${ARGN}: exited with ${rc}")
+  endif()
+  set(${var} "${out}" PARENT_SCOPE)
+endfunction()
+
+# Fixtures
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR})
+
+file(WRITE ${WORK_DIR}/ok.lisp "(a 1 \"s\" ; c\n 1/2 2.5 |x y|)\n")
+file(WRITE ${WORK_DIR}/unclosed.lisp "(x y")
+file(WRITE ${WORK_DIR}/deep.lisp "((a))")
+# Inputs of very different sizes, so that under -j the later small ones finish long before the large ones before
+# them, and the large ones fill the 64 KiB dump buffer many times over
+set(ordered)
+foreach(i RANGE 5)
+  math(EXPR odd "${i} % 2")
+  if(odd)
+    set(size 3)
+  else()
+    set(size 8000)
+  endif()
+  string(REPEAT "(f${i} 12 \"str\" 3/4 ; c\n)\n" ${size} body)
+  file(WRITE ${WORK_DIR}/f${i}.lisp "${body}")
+  list(APPEND ordered f${i}.lisp)
+endforeach()
+
+set(OK_DUMP [[0-1 OPEN_PARENTHESIS: (
+1-2 SYMBOL: a
+3-4 Literal INT: 1
+5-8 Literal STRING: s
+9-13 COMMENT: c
+14-17 Literal FRACTION: 1/2
+18-21 Literal FLOAT: 2.5
+22-27 SYMBOL: x y
+27-28 CLOSE_PARENTHESIS: )
+]])
+
+# Modes
+run("validate" ARGS ok.lisp EXIT 0 STDOUT "ok.lisp: OK\n" STDERR_MATCHES "^$")
+run("stats" ARGS --stats ok.lisp EXIT 0 STDOUT [[ok.lisp: 29 bytes, 9 tokens, max depth 1
+  OPEN_PARENTHESIS: 1
+  CLOSE_PARENTHESIS: 1
+  SYMBOL: 2
+  COMMENT: 1
+  INT: 1
+  FLOAT: 1
+  FRACTION: 1
+  STRING: 1
+]])
+run("text dump" ARGS --dump-tokens ok.lisp EXIT 0 STDOUT "${OK_DUMP}")
+run("explicit text dump" ARGS --dump-tokens=text ok.lisp EXIT 0 STDOUT "${OK_DUMP}")
+string(CONCAT bench "^ok.lisp: 9 tokens in [0-9.e+-]+ ms, [0-9.e+-]+ MB/s\n"
+  "ok.lisp: 9 tokens in [^\n]*\ntotal: 18 tokens in [^\n]*\n$")
+run("bench" ARGS --bench --repeat 2 ok.lisp ok.lisp EXIT 0 STDOUT_MATCHES "${bench}")
+
+# Binary records are {uint32 type, uint32 zero, uint64 length, uint64 start}, shown as little-endian hex
+run("binary dump" ARGS --dump-tokens=binary deep.lisp EXIT 0 OUTPUT_FILE deep.bin)
+file(READ ${WORK_DIR}/deep.bin hex HEX)
+string(CONCAT expected
+  "00000000" "00000000" "0100000000000000" "0000000000000000"
+  "00000000" "00000000" "0100000000000000" "0100000000000000"
+  "02000000" "00000000" "0100000000000000" "0200000000000000"
+  "01000000" "00000000" "0100000000000000" "0300000000000000"
+  "01000000" "00000000" "0100000000000000" "0400000000000000")
+if(NOT hex STREQUAL expected)
+  message(SEND_ERROR "binary dump: wrote ${hex} instead of ${expected}")
+endif()
+
+# Standard input, with no file or with -
+run("stdin" INPUT ok.lisp EXIT 0 STDOUT "-: OK\n")
+run("stdin dump" ARGS --dump-tokens - INPUT ok.lisp EXIT 0 STDOUT "${OK_DUMP}")
+run("stdin error" INPUT unclosed.lisp EXIT 1 STDOUT_MATCHES "^$"
+  STDERR "-:4: Unclosed open parenthesis at end of input\n")
+
+# Errors are name:offset: message and exit with 1, the files that do read are still reported
+run("unclosed" ARGS ok.lisp unclosed.lisp EXIT 1 STDOUT "ok.lisp: OK\n"
+  STDERR "unclosed.lisp:4: Unclosed open parenthesis at end of input\n")
+run("limit" ARGS --max-depth 1 deep.lisp EXIT 1 STDOUT_MATCHES "^$"
+  STDERR "deep.lisp:1: Reader limit DEPTH of 1 exceeded at token 1\n")
+run("within limit" ARGS --max-depth 2 deep.lisp EXIT 0 STDOUT "deep.lisp: OK\n")
+run("missing file" ARGS missing.lisp EXIT 1 STDERR_MATCHES "^missing.lisp:[^\n]+\n$")
+# A failing file has the tokens before its error dumped
+run("partial dump" ARGS --dump-tokens unclosed.lisp EXIT 1
+  STDOUT "0-1 OPEN_PARENTHESIS: (\n1-2 SYMBOL: x\n3-4 SYMBOL: y\n")
+
+# Usage errors exit with 2
+run("unknown option" ARGS --bogus EXIT 2 STDERR_MATCHES "^lispread: unknown option --bogus\nUsage:")
+run("missing number" ARGS -j EXIT 2 STDERR_MATCHES "^lispread: -j requires a number\nUsage:")
+run("help" ARGS --help EXIT 0 STDOUT_MATCHES "^Usage: lispread")
+
+# Output follows the order the files were given, whatever order they finish in
+set(expected_dump "")
+set(expected_binary "")
+set(expected_validate "")
+foreach(f IN LISTS ordered)
+  output_of(dump --dump-tokens ${f})
+  string(APPEND expected_dump "${dump}")
+  run("binary dump of ${f}" ARGS --dump-tokens=binary ${f} EXIT 0 OUTPUT_FILE ${f}.bin)
+  file(READ ${WORK_DIR}/${f}.bin hex HEX)
+  string(APPEND expected_binary "${hex}")
+  string(APPEND expected_validate "${f}: OK\n")
+endforeach()
+foreach(jobs 1 2 4 8)
+  run("text dump -j ${jobs}" ARGS -j ${jobs} --dump-tokens ${ordered} EXIT 0 STDOUT "${expected_dump}")
+  run("binary dump -j ${jobs}" ARGS -j ${jobs} --dump-tokens=binary ${ordered} EXIT 0 OUTPUT_FILE all.bin)
+  file(READ ${WORK_DIR}/all.bin hex HEX)
+  if(NOT hex STREQUAL expected_binary)
+    message(SEND_ERROR "binary dump -j ${jobs}: files out of order")
+  endif()
+  run("validate -j ${jobs}" ARGS -j ${jobs} ${ordered} EXIT 0 STDOUT "${expected_validate}")
+endforeach()
+# A failure in the middle keeps its place too
+run("error -j 4" ARGS -j 4 f0.lisp unclosed.lisp f1.lisp EXIT 1 STDOUT "f0.lisp: OK\nf1.lisp: OK\n"
+  STDERR "unclosed.lisp:4: Unclosed open parenthesis at end of input\n")
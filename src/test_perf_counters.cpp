@@ -0,0 +1,54 @@
+#include "catch2/catch.hpp"
+
+#include "token_profile.hpp"
+
+#include <string>
+
+using lisp_reader::PerfCounter;
+using lisp_reader::PerfCounters;
+using lisp_reader::ProfiledTokenizer;
+using lisp_reader::StringReader;
+using lisp_reader::StringTokenizer;
+using lisp_reader::TokenType;
+
+
+TEST_CASE("Counters degrade gracefully when they cannot be opened", "[perf]") {
+  PerfCounters counters;
+  REQUIRE(counters.available() == counters.has(PerfCounter::CYCLES) + counters.has(PerfCounter::INSTRUCTIONS) +
+	  counters.has(PerfCounter::BRANCH_MISSES) + counters.has(PerfCounter::CACHE_MISSES) +
+	  counters.has(PerfCounter::L1D_MISSES) > 0);
+  if(!counters.available()) {
+    REQUIRE_FALSE(counters.error().empty());
+
+    // Everything is still safe to call, and reads as zeros
+    counters.start();
+    counters.stop();
+    for(auto v : counters.read().values) REQUIRE(v == 0);
+  }
+}
+
+TEST_CASE("Profiled reads are tallied by token type", "[perf]") {
+  std::string input = "(foo 1 2.5 \"bar\") ; done\n";
+  StringTokenizer plain{StringReader(input)};
+  StringTokenizer tok{StringReader(input)};
+  ProfiledTokenizer<StringReader> prof(tok);
+
+  // The wrapper does not change what is read
+  while(prof.canRead()) REQUIRE(prof.read() == plain.read());
+  REQUIRE_FALSE(plain.canRead());
+
+  const lisp_reader::TokenProfile &p = prof.profile();
+  REQUIRE(p[TokenType::OPEN_PARENTHESIS].tokens == 1);
+  REQUIRE(p[TokenType::SYMBOL].tokens == 1);
+  REQUIRE(p[TokenType::SYMBOL].bytes == 4);
+  REQUIRE(p[TokenType::INT].tokens == 1);
+  REQUIRE(p[TokenType::FLOAT].tokens == 1);
+  REQUIRE(p[TokenType::STRING].bytes == 5);
+  REQUIRE(p[TokenType::CLOSE_PARENTHESIS].bytes == 2);
+  REQUIRE(p[TokenType::COMMENT].tokens == 1);
+
+  // Every byte of input is accounted to some token
+  std::size_t bytes = 0;
+  for(const auto &e : p.types) bytes += e.bytes;
+  REQUIRE(bytes == input.size());
+}
@@ -0,0 +1,91 @@
+import mmap
+import tempfile
+
+import numpy as np
+import pytest
+
+import lisp_reader
+from lisp_reader import TokenType
+
+
+# Helper methods
+def token_text(tokens, i):
+    return bytes(tokens["text"][tokens["text_offsets"][i]:tokens["text_offsets"][i + 1]])
+
+
+SOURCE = b'(abc 12 1.5 2d1 3/4 "s t" |p q| b\\ c ; cmt\n)'
+
+
+def test_reads_tokens_into_columns():
+    tokens = lisp_reader.tokenize(SOURCE)
+
+    types = [TokenType.OPEN_PARENTHESIS, TokenType.SYMBOL, TokenType.INT, TokenType.FLOAT, TokenType.DOUBLE,
+             TokenType.FRACTION, TokenType.STRING, TokenType.SYMBOL, TokenType.SYMBOL, TokenType.COMMENT,
+             TokenType.CLOSE_PARENTHESIS]
+    assert tokens["type"].tolist() == [int(t) for t in types]
+    for column, dtype in [("type", np.uint8), ("start", np.uint64), ("end", np.uint64), ("int", np.int64),
+                          ("float", np.float64), ("text", np.uint8), ("text_offsets", np.uint64)]:
+        assert tokens[column].dtype == dtype
+
+    assert tokens["int"][2] == 12
+    assert tokens["float"][3] == 1.5
+    assert tokens["float"][4] == 20.0
+    assert (tokens["int"][5], tokens["float"][5]) == (3, 4.0)
+
+    # start and end slice the token as written
+    raw = [SOURCE[s:e] for s, e in zip(tokens["start"], tokens["end"])]
+    assert raw[:7] == [b"(", b"abc", b"12", b"1.5", b"2d1", b"3/4", b'"s t"']
+    assert raw[7] == b"|p q|"
+    assert raw[-1] == b")"
+
+    # text is what the reader decoded, and empty for tokens without any
+    assert len(tokens["text_offsets"]) == len(types) + 1
+    assert [token_text(tokens, i) for i in range(len(types))] == [
+        b"", b"abc", b"", b"", b"", b"", b"s t", b"p q", b"b c", b"cmt", b""]
+
+
+def test_reads_any_contiguous_buffer():
+    expected = lisp_reader.tokenize(SOURCE)
+
+    with tempfile.TemporaryFile() as f:
+        f.write(SOURCE)
+        f.flush()
+        with mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ) as mapped:
+            inputs = [bytearray(SOURCE), memoryview(SOURCE), mapped]
+            for buf in inputs:
+                tokens = lisp_reader.tokenize(buf)
+                for column in expected:
+                    assert np.array_equal(tokens[column], expected[column])
+
+    with pytest.raises(ValueError):
+        lisp_reader.tokenize(memoryview(SOURCE)[::2])
+
+
+def test_reads_empty_input():
+    tokens = lisp_reader.tokenize(b"  \n")
+    assert len(tokens["type"]) == 0
+    assert tokens["text_offsets"].tolist() == [0]
+
+
+@pytest.mark.parametrize("source, limits, message", [
+    (b"((a))", {"max_depth": 1}, "DEPTH"),
+    (b"abcdefgh", {"max_token_length": 4}, "TOKEN_LENGTH"),
+    (b'"abcdefgh"', {"max_string_length": 4}, "STRING_LENGTH"),
+    (b"a b c", {"max_tokens": 2}, "TOKENS"),
+])
+def test_enforces_limits(source, limits, message):
+    with pytest.raises(ValueError, match=message):
+        lisp_reader.tokenize(source, **limits)
+    # Within the limits the same input reads
+    lisp_reader.tokenize(source, **{name: 100 for name in limits})
+
+
+def test_rejects_negative_limits():
+    with pytest.raises(ValueError):
+        lisp_reader.tokenize(b"a", max_depth=-1)
+
+
+@pytest.mark.parametrize("source", [b'"open', b"a|", b"a,b", b"0/0", b"1/0", b"99999999999"])
+def test_rejects_malformed_input(source):
+    with pytest.raises(ValueError):
+        lisp_reader.tokenize(source)
@@ -0,0 +1,35 @@
+// The parts of the reader that need C++20, built on their own so the other tests stay on C++17
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include "reader.hpp"
+#include "token_range.hpp"
+
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using lisp_reader::Token;
+using lisp_reader::TokenType;
+
+static_assert(std::ranges::input_range<lisp_reader::TokenRange<lisp_reader::StringReader>>);
+static_assert(std::ranges::view<lisp_reader::TokenRange<lisp_reader::StreamReader>>);
+
+TEST_CASE("Token ranges compose with views", "[ranges]") {
+  const std::string content = "(defun f (x) ; twice\n  (* x 2))  \n";
+
+  // Skipping comments and keeping symbols
+  std::vector<std::string> symbols;
+  for(std::string_view s : lisp_reader::tokens(content)
+	| std::views::filter([](const Token &t) {return t.first == TokenType::SYMBOL;})
+	| std::views::transform([](const Token &t) {return std::string_view(std::get<lisp_reader::SmallString>(*t.second));}))
+    symbols.emplace_back(s);
+  REQUIRE(symbols == std::vector<std::string>{"defun", "f", "x", "*", "x"});
+
+  // Taking only the first tokens leaves the rest unread
+  std::size_t parens = 0;
+  for(const Token &t : lisp_reader::tokens(content) | std::views::take(3))
+    parens += t.first == TokenType::OPEN_PARENTHESIS;
+  REQUIRE(parens == 1);
+}
@@ -2,9 +2,17 @@
 #include "catch2/catch.hpp"
 
 #include "reader.hpp"
+#include "mmap_reader.hpp"
+#include "pipelined_reader.hpp"
+#include "compressed_reader.hpp"
+#include "token_range.hpp"
+#include "paren_index.hpp"
+#include "corpus.hpp"
 
 #include <vector>
 #include <sstream>
+#include <fstream>
+#include <filesystem>
 
 using lisp_reader::StreamTokenizer;
 using lisp_reader::StringTokenizer;
@@ -12,6 +20,9 @@ using lisp_reader::Tokenizer;
 using lisp_reader::Token;
 using lisp_reader::TokenType;
 using lisp_reader::TokenValue;
+using lisp_reader::ReaderLimits;
+using lisp_reader::LimitError;
+using lisp_reader::Limit;
 
 // Helper methods
 template <typename T>
@@ -28,6 +39,21 @@ void checkStringTokenizerOutput(std::string_view str, const std::vector<Token> &
   checkTokenizerOutput(tok, tokens);
 }
 
+// Rebuilds tokens out of events, to compare them with what read() returns
+struct TokenRecorder : lisp_reader::EventHandler<TokenRecorder> {
+  std::vector<Token> tokens;
+
+  void onOpen() {tokens.emplace_back(TokenType::OPEN_PARENTHESIS, std::nullopt);}
+  void onClose() {tokens.emplace_back(TokenType::CLOSE_PARENTHESIS, std::nullopt);}
+  void onSymbol(std::string_view s) {tokens.emplace_back(TokenType::SYMBOL, std::string(s));}
+  void onString(std::string_view s) {tokens.emplace_back(TokenType::STRING, std::string(s));}
+  void onComment(std::string_view s) {tokens.emplace_back(TokenType::COMMENT, std::string(s));}
+  void onInt(int v) {tokens.emplace_back(TokenType::INT, v);}
+  void onFloat(float v) {tokens.emplace_back(TokenType::FLOAT, v);}
+  void onDouble(double v) {tokens.emplace_back(TokenType::DOUBLE, v);}
+  void onFraction(const lisp_reader::Fraction &v) {tokens.emplace_back(TokenType::FRACTION, v);}
+};
+
 
 TEST_CASE("Knows when it can and cannot read anymore", "[reader]") {
   {
@@ -57,7 +83,7 @@ TEST_CASE("Can read several consecutive parenthesis", "[reader]") {
 
 TEST_CASE("Can read standalone string literals", "[reader]") {
   checkStringTokenizerOutput("\"Hello, World\"", {Token{TokenType::STRING, std::string("Hello, World")}});
-  checkStringTokenizerOutput("\"\"", {Token{TokenType::STRING, std::string("\"\"")}});
+  checkStringTokenizerOutput("\"\"", {Token{TokenType::STRING, std::string("")}});
 }
 
 TEST_CASE("Can read standalone comments", "[reader]") {
@@ -65,6 +91,7 @@ TEST_CASE("Can read standalone comments", "[reader]") {
   checkStringTokenizerOutput(";Test Comment", {Token{TokenType::COMMENT, std::string("Test Comment")}});
   checkStringTokenizerOutput(";;; Test Comment ;;", {Token{TokenType::COMMENT, std::string("Test Comment ;;")}});
   checkStringTokenizerOutput(";;;Test Comment;;  ", {Token{TokenType::COMMENT, std::string("Test Comment;;  ")}});
+  checkStringTokenizerOutput(";;;", {Token{TokenType::COMMENT, std::string("")}});
 }
 
 TEST_CASE("Can read standalone symbols", "[reader]") {
@@ -83,6 +110,26 @@ TEST_CASE("Can read standalone symbols", "[reader]") {
   checkStringTokenizerOutput("23.3d", {Token{TokenType::SYMBOL, std::string("23.3d")}});
   checkStringTokenizerOutput("23232/", {Token{TokenType::SYMBOL, std::string("23232/")}});
   checkStringTokenizerOutput("32/-3", {Token{TokenType::SYMBOL, std::string("32/-3")}});
+  checkStringTokenizerOutput("1.2.3", {Token{TokenType::SYMBOL, std::string("1.2.3")}});
+  checkStringTokenizerOutput("1..", {Token{TokenType::SYMBOL, std::string("1..")}});
+  checkStringTokenizerOutput("1.5x", {Token{TokenType::SYMBOL, std::string("1.5x")}});
+  checkStringTokenizerOutput("1.5e3d4", {Token{TokenType::SYMBOL, std::string("1.5e3d4")}});
+  checkStringTokenizerOutput("1e5e5", {Token{TokenType::SYMBOL, std::string("1e5e5")}});
+  checkStringTokenizerOutput("+e5", {Token{TokenType::SYMBOL, std::string("+e5")}});
+  checkStringTokenizerOutput("-/2", {Token{TokenType::SYMBOL, std::string("-/2")}});
+  checkStringTokenizerOutput("1\\2", {Token{TokenType::SYMBOL, std::string("12")}});
+  checkStringTokenizerOutput("||", {Token{TokenType::SYMBOL, std::string("")}});
+  checkStringTokenizerOutput("|..|", {Token{TokenType::SYMBOL, std::string("..")}});
+}
+
+TEST_CASE("Rejects unclosed escapes in symbols", "[reader]") {
+  for(const char *str : {"|", "a|", "|abc", "a|b", "(a |b)"}) {
+    INFO(str);
+    StringTokenizer tok(str);
+    REQUIRE_THROWS_WITH([&tok] {while(tok.canRead()) tok.read();}(), "Unclosed pipe character found");
+  }
+  StringTokenizer tok("a\\");
+  REQUIRE_THROWS_WITH(tok.read(), "Cannot end symbol with unescaped backslash");
 }
 
 TEST_CASE("Can read multiple consecutive symbols", "[reader]") {
@@ -107,12 +154,579 @@ TEST_CASE("Can read standalone floats", "[reader]") {
   checkStringTokenizerOutput("32.4e4", {Token{TokenType::FLOAT, 32.4e4f}});
 }
 
+TEST_CASE("Only parses numeric text that is all number", "[reader]") {
+  using namespace lisp_reader::detail;
+  // Exponents without any mantissa digits
+  REQUIRE_THROWS_AS(parseFloat(".e5"), std::invalid_argument);
+  REQUIRE_THROWS_AS(parseFloat("+.e5"), std::invalid_argument);
+  REQUIRE_THROWS_AS(parseDouble(".e5"), std::invalid_argument);	// .d5, once the marker is swapped
+  REQUIRE_THROWS_AS(parseDouble(""), std::invalid_argument);
+  REQUIRE_THROWS_AS(parseInt("1x"), std::invalid_argument);
+  REQUIRE_THROWS_AS(parseInt("1/2"), std::invalid_argument);
+  REQUIRE_THROWS_AS(parseInt("99999999999"), std::out_of_range);
+  REQUIRE_THROWS_AS(parseFraction("0/0"), std::invalid_argument);
+  REQUIRE_THROWS_AS(parseFraction("1/0"), std::invalid_argument);
+  REQUIRE_THROWS_AS(lisp_reader::Fraction(1, 0), std::invalid_argument);
+
+  REQUIRE(parseInt("-12.") == -12);
+  REQUIRE(parseInt("3/4", '/') == 3);
+  REQUIRE(parseFraction("-3/6") == lisp_reader::Fraction(-1, 2));
+  REQUIRE(parseFloat("1.e5") == 1e5f);
+  REQUIRE(parseDouble("-.5e-1") == -.05);
+}
+
+TEST_CASE("Rejects fractions with a zero denominator", "[reader]") {
+  for(const char *str : {"0/0", "1/0", "(0/0)", "-7/000"}) {
+    INFO(str);
+    StringTokenizer tok(str);
+    REQUIRE_THROWS_WITH([&tok] {while(tok.canRead()) tok.read();}(), "Fraction with zero denominator");
+  }
+  checkStringTokenizerOutput("0/1", {Token{TokenType::INT, 0}});
+}
+
 TEST_CASE("Can read standalone doubles", "[reader]") {
   checkStringTokenizerOutput("32d1", {Token{TokenType::DOUBLE, 32e1}});
   checkStringTokenizerOutput("1.2d3", {Token{TokenType::DOUBLE, 1.2e3}});
   checkStringTokenizerOutput("3.4d-4", {Token{TokenType::DOUBLE, 3.4e-4}});
 }
 
+TEST_CASE("Can read pathological atoms in linear time", "[reader]") {
+  // Each of these used to rescan the whole atom on every character
+  const std::size_t len = 1 << 20;
+  {
+    std::string atom = "1.1";
+    atom.resize(len, '.');
+    checkStringTokenizerOutput(atom, {Token{TokenType::SYMBOL, atom}});
+  }
+  {
+    std::string atom = "1.1e";
+    atom.resize(len, 'e');
+    checkStringTokenizerOutput(atom, {Token{TokenType::SYMBOL, atom}});
+  }
+}
+
+TEST_CASE("Can read whitespace separated and parenthesized atoms", "[reader]") {
+  checkStringTokenizerOutput("  (a\t1\n2.5)  ", {Token{TokenType::OPEN_PARENTHESIS, std::optional<TokenValue>()},
+						Token{TokenType::SYMBOL, std::string("a")},
+						Token{TokenType::INT, 1},
+						Token{TokenType::FLOAT, 2.5f},
+						Token{TokenType::CLOSE_PARENTHESIS, std::optional<TokenValue>()}});
+  checkStringTokenizerOutput("(a\"b\"c;d\n)", {Token{TokenType::OPEN_PARENTHESIS, std::optional<TokenValue>()},
+					     Token{TokenType::SYMBOL, std::string("a")},
+					     Token{TokenType::STRING, std::string("b")},
+					     Token{TokenType::SYMBOL, std::string("c")},
+					     Token{TokenType::COMMENT, std::string("d")},
+					     Token{TokenType::CLOSE_PARENTHESIS, std::optional<TokenValue>()}});
+
+  std::istringstream is("(1 2)\n");
+  StreamTokenizer tok{lisp_reader::StreamReader(is)};
+  checkTokenizerOutput(tok, {Token{TokenType::OPEN_PARENTHESIS, std::optional<TokenValue>()},
+			     Token{TokenType::INT, 1},
+			     Token{TokenType::INT, 2},
+			     Token{TokenType::CLOSE_PARENTHESIS, std::optional<TokenValue>()}});
+}
+
+// Reads everything from str with the given limits, returning which limit was hit if any
+std::optional<Limit> readWithLimits(std::string_view str, ReaderLimits limits) {
+  StringTokenizer tok(str, limits);
+  try {
+    while(tok.canRead()) tok.read();
+  }
+  catch(const LimitError &e) {
+    return e.limit();
+  }
+
+  return std::nullopt;
+}
+
+TEST_CASE("Enforces reader limits", "[reader]") {
+  ReaderLimits limits;
+  limits.maxTokenLength = 4;
+  REQUIRE(readWithLimits("abcd 1234 \"abcd\" ;abcd", limits) == std::nullopt);
+  REQUIRE(readWithLimits("abcde", limits) == Limit::TOKEN_LENGTH);
+  REQUIRE(readWithLimits("\"abcde\"", limits) == Limit::TOKEN_LENGTH);
+  REQUIRE(readWithLimits(";abcde", limits) == Limit::TOKEN_LENGTH);
+  REQUIRE(readWithLimits(std::string(1 << 20, 'a'), limits) == Limit::TOKEN_LENGTH);
+
+  limits = ReaderLimits{};
+  limits.maxStringLength = 2;
+  REQUIRE(readWithLimits("abcde \"ab\"", limits) == std::nullopt);
+  REQUIRE(readWithLimits("\"abc\"", limits) == Limit::STRING_LENGTH);
+
+  limits = ReaderLimits{};
+  limits.maxDepth = 2;
+  REQUIRE(readWithLimits("(()) (())", limits) == std::nullopt);
+  REQUIRE(readWithLimits("((()))", limits) == Limit::DEPTH);
+
+  limits = ReaderLimits{};
+  limits.maxTokens = 3;
+  REQUIRE(readWithLimits("a b c", limits) == std::nullopt);
+  REQUIRE(readWithLimits("a b c d", limits) == Limit::TOKENS);
+
+  try {
+    StringTokenizer tok("a b c d", limits);
+    while(tok.canRead()) tok.read();
+    FAIL("Expected a LimitError");
+  }
+  catch(const LimitError &e) {
+    REQUIRE(e.max() == 3);
+    REQUIRE(e.token() == 3);
+  }
+}
+
+TEST_CASE("Keeps the text of short tokens inline", "[reader]") {
+  std::string longSym(100, 'x');
+  std::string input = "abcdefghijklmnopqrstuvw \"a string\" " + longSym + " ;; a comment";
+  StringTokenizer tok(input);
+  std::vector<Token> tokens;
+  while(tok.canRead()) tokens.push_back(tok.read());
+
+  REQUIRE(tokens.size() == 4);
+  REQUIRE(lisp_reader::getTokenVal<TokenType::SYMBOL>(*tokens[0].second).isInline());
+  REQUIRE(lisp_reader::getTokenVal<TokenType::SYMBOL>(*tokens[0].second) == "abcdefghijklmnopqrstuvw");
+  REQUIRE(lisp_reader::getTokenVal<TokenType::STRING>(*tokens[1].second).isInline());
+  REQUIRE(!lisp_reader::getTokenVal<TokenType::SYMBOL>(*tokens[2].second).isInline());
+  REQUIRE(lisp_reader::getTokenVal<TokenType::SYMBOL>(*tokens[2].second) == longSym);
+  REQUIRE(lisp_reader::getTokenVal<TokenType::COMMENT>(*tokens[3].second) == "a comment");
+
+  // Moves hand over the heap buffer, copies make their own
+  lisp_reader::SmallString moved(std::move(lisp_reader::getTokenVal<TokenType::SYMBOL>(*tokens[2].second)));
+  REQUIRE(moved == longSym);
+  REQUIRE(lisp_reader::getTokenVal<TokenType::SYMBOL>(*tokens[2].second).empty());
+  lisp_reader::SmallString copy(moved);
+  REQUIRE(copy == moved);
+  REQUIRE(copy.data() != moved.data());
+  copy = "short";
+  REQUIRE(copy == "short");
+  REQUIRE(std::string_view(copy.c_str()) == "short");
+}
+
+TEST_CASE("Reports the span of each token", "[reader]") {
+  StringTokenizer tok("  (abc \"d e\")\n; x\n12");
+  std::vector<std::pair<std::size_t, std::size_t>> spans;
+  while(tok.canRead()) {
+    tok.read();
+    spans.push_back(tok.span());
+  }
+
+  REQUIRE(spans == std::vector<std::pair<std::size_t, std::size_t>>{{2, 3}, {3, 6}, {7, 12}, {12, 13}, {14, 18}, {18, 20}});
+}
+
+TEST_CASE("Can checkpoint and restore the tokenizer", "[reader]") {
+  const std::string content = "(defun f (x) ; twice\n  (* x 2))\n(f \"a b\" 1/2)";
+  std::vector<Token> all;
+  StringTokenizer str(content);
+  while(str.canRead()) all.push_back(str.read());
+
+  for(std::size_t at = 0; at < all.size(); ++at) {
+    StringTokenizer tok(content);
+    for(std::size_t i = 0; i < at; ++i) tok.read();
+    lisp_reader::Checkpoint cp = tok.checkpoint();
+    std::size_t depth = tok.depth();
+    std::vector<Token> rest(all.begin() + at, all.end());
+
+    // Going back after reading on
+    checkTokenizerOutput(tok, rest);
+    tok.restore(cp);
+    REQUIRE(tok.depth() == depth);
+    REQUIRE(tok.count() == at);
+    checkTokenizerOutput(tok, rest);
+
+    // Resuming in a fresh tokenizer, from a stream and from a string
+    std::istringstream is(content);
+    lisp_reader::StreamTokenizer stream{lisp_reader::StreamReader(is)};
+    stream.restore(cp);
+    REQUIRE(stream.checkpoint().offset == cp.offset);
+    checkTokenizerOutput(stream, rest);
+
+    StringTokenizer fresh(content);
+    fresh.restore(cp);
+    REQUIRE(fresh.count() == at);
+    checkTokenizerOutput(fresh, rest);
+  }
+
+  // Any byte offset works, as long as a token starts there or after some whitespace
+  StringTokenizer tok(content);
+  tok.restore({content.find("(f"), 0, 0});
+  REQUIRE(tok.read().first == TokenType::OPEN_PARENTHESIS);
+  REQUIRE(tok.read() == Token{TokenType::SYMBOL, std::string("f")});
+  tok.restore({content.size() + 10, 0, 0});
+  REQUIRE(!tok.canRead());
+}
+
+TEST_CASE("Can read tokens as events", "[reader]") {
+  const std::vector<std::string> inputs{
+    "(defun f (x) ; twice\n  (* x 2))", "(\"a b\" |c d| e\\ f 1 -2. .5 1e3 1.5d-3 3/6 2/4 +7/3 ...x)", "",
+    "(((a)))", "(a", "a)", std::string(100, 'x') + " \"" + std::string(50, 'y') + "\"",
+    "1 2 99999999999", "(0/0)", "1/0 x", "\"unclosed", "a|b", "a|", "|", "a,b", "...", "a\\", "1e99999 x"
+  };
+  ReaderLimits none, small;
+  small.maxTokenLength = 16;
+  small.maxDepth = 2;
+  small.maxTokens = 5;
+
+  for(const std::string &str : inputs)
+    for(const ReaderLimits &limits : {none, small}) {
+      INFO(str);
+      StringTokenizer tok(str, limits), events(str, limits);
+      TokenRecorder rec;
+      std::vector<Token> tokens;
+      std::string error, eventError;
+      try {
+	while(tok.canRead()) tokens.push_back(tok.read());
+      }
+      catch(const char *e) {error = e;}
+      catch(const std::exception &e) {error = e.what();}
+      try {
+	events.readEvents(rec);
+      }
+      catch(const char *e) {eventError = e;}
+      catch(const std::exception &e) {eventError = e.what();}
+
+      REQUIRE(rec.tokens == tokens);
+      REQUIRE(eventError == error);
+      REQUIRE(events.count() == tok.count());
+      REQUIRE(events.depth() == tok.depth());
+      REQUIRE(events.offset() == tok.offset());
+    }
+
+  // Only what the handler defines gets called, floats go to onDouble unless it takes them
+  struct Sum : lisp_reader::EventHandler<Sum> {
+    double sum = 0;
+    void onDouble(double v) {sum += v;}
+  } sum;
+  StringTokenizer tok("(a 1.5 \"b\" 2 2.5d0 1/2)");
+  tok.readEvents(sum);
+  REQUIRE(sum.sum == 4);
+}
+
+TEST_CASE("Can iterate over tokens as a range", "[reader]") {
+  const std::string content = "(defun f (x) ; twice\n  (* x 2))  \n";
+  std::vector<Token> expected;
+  StringTokenizer tok(content);
+  while(tok.canRead()) expected.push_back(tok.read());
+
+  std::vector<Token> fromString, fromStream;
+  for(Token &t : lisp_reader::tokens(content)) fromString.push_back(std::move(t));
+  std::istringstream is(content);
+  for(const Token &t : lisp_reader::tokens(is)) fromStream.push_back(t);
+  REQUIRE(fromString == expected);
+  REQUIRE(fromStream == expected);
+
+  auto range = lisp_reader::tokens(StringTokenizer(content));
+  auto it = range.begin();
+  REQUIRE(it->first == TokenType::OPEN_PARENTHESIS);
+  REQUIRE(range.tokenizer().depth() == 1);
+  ++it;
+  REQUIRE(*it == Token{TokenType::SYMBOL, std::string("defun")});
+
+  for(const char *empty : {"", "  \n "})
+    REQUIRE(lisp_reader::tokens(empty).begin() == lisp_reader::TokenSentinel{});
+
+  // Errors come out of the iteration
+  auto unclosed = lisp_reader::tokens("a \"b");
+  auto at = unclosed.begin();
+  REQUIRE_THROWS_WITH(++at, "Missing closing double-quotes for string literal");
+}
+
+// The parenthesis read by a tokenizer, with their depth and match, as a ParenIndex should have them
+// Returns false if the tokenizer failed
+bool tokenizerParens(std::string_view str, std::vector<std::size_t> &offsets, std::vector<std::size_t> &depths,
+		     std::vector<std::size_t> &matches) {
+  StringTokenizer tok(str);
+  std::vector<std::size_t> open;
+  try {
+    while(tok.canRead()) {
+      std::size_t depth = tok.depth();
+      Token t = tok.read();
+      if(t.first != TokenType::OPEN_PARENTHESIS && t.first != TokenType::CLOSE_PARENTHESIS) continue;
+
+      std::size_t at = tok.span().first;
+      offsets.push_back(at);
+      matches.push_back(lisp_reader::ParenIndex::npos);
+      if(t.first == TokenType::OPEN_PARENTHESIS) {
+	depths.push_back(tok.depth());
+	open.push_back(offsets.size() - 1);
+      }
+      else {
+	depths.push_back(open.empty() ? 0 : depth);
+	if(!open.empty()) {
+	  matches.back() = offsets[open.back()];
+	  matches[open.back()] = at;
+	  open.pop_back();
+	}
+      }
+    }
+  }
+  catch(...) {
+    return false;
+  }
+
+  return true;
+}
+
+TEST_CASE("Indexes the parenthesis the tokenizer reads", "[reader]") {
+  std::vector<std::string> inputs;
+  // Everything short that can hide a parenthesis or not, with the escapes the grammar has
+  std::string alphabet = "()\";\na";
+  for(int c = 0; c < 256; ++c)
+    if(lisp_reader::dfa::stopAction(static_cast<char>(c)) == lisp_reader::dfa::ESCAPE)
+      alphabet += static_cast<char>(c);
+  std::string str;
+  for(std::size_t len = 1; len <= 6; ++len) {
+    std::size_t total = 1;
+    for(std::size_t i = 0; i < len; ++i) total *= alphabet.size();
+    str.resize(len);
+    for(std::size_t n = 0; n < total; ++n) {
+      for(std::size_t i = 0, k = n; i < len; ++i, k /= alphabet.size()) str[i] = alphabet[k % alphabet.size()];
+      inputs.push_back(str);
+    }
+  }
+  // Long enough to span many blocks, with escapes, strings and comments
+  lisp_reader::CorpusOptions opts;
+  opts.escapeRate = 0.3;
+  opts.nestProbability = 0.6;
+  for(std::uint64_t seed = 1; seed <= 4; ++seed) {
+    opts.seed = seed;
+    inputs.emplace_back();
+    lisp_reader::CorpusGenerator(opts).generate(inputs.back(), 64 << 10);
+  }
+
+  std::size_t compared = 0;
+  for(const std::string &in : inputs) {
+    std::vector<std::size_t> offsets, depths, matches;
+    if(!tokenizerParens(in, offsets, depths, matches)) continue;
+    ++compared;
+
+    INFO(in);
+    lisp_reader::ParenIndex index(in);
+    REQUIRE(index.offsets() == offsets);
+    bool balanced = true;
+    for(std::size_t i = 0; i < offsets.size(); ++i) {
+      REQUIRE(index.isParen(offsets[i]));
+      REQUIRE(index.depth(offsets[i]) == depths[i]);
+      REQUIRE(index.match(offsets[i]) == matches[i]);
+      if(balanced && matches[i] == lisp_reader::ParenIndex::npos) {
+	balanced = false;
+	REQUIRE(index.firstUnmatched() == offsets[i]);
+      }
+    }
+    REQUIRE(index.balanced() == balanced);
+  }
+  REQUIRE(compared > 10000);
+
+  // Exactly the characters that start or end tokens hiding parenthesis are structural, whichever the grammar
+  // escapes with
+  std::string block(64, ' ');
+  for(int c = 0; c < 256; ++c) {
+    INFO(c);
+    block[5] = static_cast<char>(c);
+    bool structural = lisp_reader::dfa::stopAction(block[5]) == lisp_reader::dfa::ESCAPE ||
+      std::string_view("()\";\n").find(block[5]) != std::string_view::npos;
+    REQUIRE(lisp_reader::detail::structuralBitsScalar(block.data()) == (structural ? 1u << 5 : 0u));
+    REQUIRE(lisp_reader::detail::structuralBits(block.data()) == (structural ? 1u << 5 : 0u));
+  }
+
+  // The vector classifier agrees with the plain one
+  for(std::size_t i = 0; i < inputs.back().size() - 64; i += 7) {
+    block.assign(inputs.back(), i, 64);
+    REQUIRE(lisp_reader::detail::structuralBits(block.data()) == lisp_reader::detail::structuralBitsScalar(block.data()));
+  }
+}
+
+TEST_CASE("Skips whole lists through the paren index", "[reader]") {
+  const std::string content = "(a (b \")\" ; )\n c |)| d\\))) (e f) g";
+  lisp_reader::ParenIndex index(content);
+  REQUIRE(index.balanced());
+
+  StringTokenizer tok(content);
+  REQUIRE(tok.read().first == TokenType::OPEN_PARENTHESIS);
+  REQUIRE(tok.read() == Token{TokenType::SYMBOL, std::string("a")});
+  REQUIRE(tok.read().first == TokenType::OPEN_PARENTHESIS);
+  REQUIRE(index.skipList(tok));
+  REQUIRE(tok.depth() == 1);
+  REQUIRE(tok.read().first == TokenType::CLOSE_PARENTHESIS);
+  REQUIRE(tok.read().first == TokenType::OPEN_PARENTHESIS);
+  REQUIRE(index.skipList(tok));
+  REQUIRE(tok.depth() == 0);
+  REQUIRE(tok.read() == Token{TokenType::SYMBOL, std::string("g")});
+  REQUIRE(tok.count() == 6);
+
+  lisp_reader::ParenIndex unclosed("(a (b)");
+  REQUIRE(!unclosed.balanced());
+  REQUIRE(unclosed.firstUnmatched() == 0);
+  StringTokenizer open("(a (b)");
+  open.read();
+  REQUIRE(!unclosed.skipList(open));
+  REQUIRE(open.read() == Token{TokenType::SYMBOL, std::string("a")});
+}
+
+TEST_CASE("Can read memory mapped files", "[reader]") {
+  std::filesystem::path path = std::filesystem::temp_directory_path() / "cpplispreader_mmap_test.lisp";
+  std::ofstream(path) << "(a 1)\n";
+  {
+    lisp_reader::MmapTokenizer tok{lisp_reader::MmapReader(path.string())};
+    tok.read();
+    lisp_reader::Checkpoint cp = tok.checkpoint();
+    checkTokenizerOutput(tok, {Token{TokenType::SYMBOL, std::string("a")},
+			       Token{TokenType::INT, 1},
+			       Token{TokenType::CLOSE_PARENTHESIS, std::optional<TokenValue>()}});
+    tok.restore(cp);
+    REQUIRE(tok.depth() == 1);
+    REQUIRE(tok.read() == Token{TokenType::SYMBOL, std::string("a")});
+  }
+  std::ofstream(path, std::ios::trunc);
+  {
+    lisp_reader::MmapTokenizer tok{lisp_reader::MmapReader(path.string())};
+    REQUIRE(!tok.canRead());
+  }
+  std::filesystem::remove(path);
+
+  REQUIRE_THROWS_AS(lisp_reader::MmapReader(path.string()), std::system_error);
+}
+
+TEST_CASE("Can read files through the pipelined reader", "[reader]") {
+  std::filesystem::path path = std::filesystem::temp_directory_path() / "cpplispreader_pipelined_test.lisp";
+  std::string content;
+  for(int i = 0; i < 100; ++i)
+    content += "(abc \"d e\" " + std::to_string(i) + ")\n";
+  std::ofstream(path) << content;
+
+  std::vector<Token> expected;
+  StringTokenizer str(content);
+  while(str.canRead()) expected.push_back(str.read());
+
+  // Chunks much smaller than a token, so tokens straddle several of them
+  for(std::size_t chunkSize : {1, 3, 7, 64, 1 << 20}) {
+    lisp_reader::PipelinedTokenizer tok{lisp_reader::PipelinedFileReader(path.string(), chunkSize)};
+    checkTokenizerOutput(tok, expected);
+    REQUIRE(tok.offset() == content.size());
+  }
+
+  std::ofstream(path, std::ios::trunc);
+  {
+    lisp_reader::PipelinedTokenizer tok{lisp_reader::PipelinedFileReader(path.string())};
+    REQUIRE(!tok.canRead());
+  }
+  std::filesystem::remove(path);
+
+  REQUIRE_THROWS_AS(lisp_reader::PipelinedFileReader(path.string()), std::system_error);
+}
+
+#ifdef LISP_READER_HAVE_ZLIB
+TEST_CASE("Can read gzip compressed files", "[reader]") {
+  std::filesystem::path path = std::filesystem::temp_directory_path() / "cpplispreader_gzip_test.lisp.gz";
+  std::string content;
+  for(int i = 0; i < 100; ++i)
+    content += "(abc \"d e\" " + std::to_string(i) + ")\n";
+
+  // Written as two members, the way concatenated or parallel compressors produce them
+  std::size_t half = content.size() / 2;
+  for(auto [mode, part] : {std::make_pair("wb", content.substr(0, half)), std::make_pair("ab", content.substr(half))}) {
+    gzFile gz = gzopen(path.string().c_str(), mode);
+    REQUIRE(gz);
+    gzwrite(gz, part.data(), static_cast<unsigned>(part.size()));
+    gzclose(gz);
+  }
+
+  std::vector<Token> expected;
+  StringTokenizer str(content);
+  while(str.canRead()) expected.push_back(str.read());
+
+  for(bool threaded : {false, true})
+    for(std::size_t chunkSize : {1, 7, 64, 1 << 20}) {
+      lisp_reader::GzipTokenizer tok{lisp_reader::GzipReader(path.string(), threaded, chunkSize)};
+      checkTokenizerOutput(tok, expected);
+      REQUIRE(tok.offset() == content.size());
+    }
+
+  // Errors from the decompressor surface on the reading thread
+  std::ofstream(path, std::ios::binary | std::ios::trunc) << "\x1f\x8b\x08\x00 not really gzip";
+  for(bool threaded : {false, true}) {
+    lisp_reader::GzipReader reader(path.string(), threaded);
+    REQUIRE_THROWS_AS(reader.canRead(), std::runtime_error);
+  }
+  std::filesystem::remove(path);
+
+  REQUIRE_THROWS_AS(lisp_reader::GzipReader(path.string()), std::system_error);
+}
+#endif
+
+#ifdef LISP_READER_HAVE_ZSTD
+TEST_CASE("Can read zstd compressed files", "[reader]") {
+  std::filesystem::path path = std::filesystem::temp_directory_path() / "cpplispreader_zstd_test.lisp.zst";
+  // Compresses far below the decoder's block size, so a single read of input holds more output than a chunk
+  std::string content;
+  for(int i = 0; i < 20000; ++i)
+    content += "(abc \"d e\" " + std::to_string(i % 10) + ")\n";
+
+  // Written as two frames, the way concatenated or parallel compressors produce them
+  std::string compressed;
+  std::size_t half = content.size() / 2;
+  for(const std::string &part : {content.substr(0, half), content.substr(half)}) {
+    std::string frame(ZSTD_compressBound(part.size()), '\0');
+    std::size_t n = ZSTD_compress(frame.data(), frame.size(), part.data(), part.size(), 3);
+    REQUIRE(!ZSTD_isError(n));
+    compressed.append(frame, 0, n);
+  }
+  REQUIRE(compressed.size() < lisp_reader::COMPRESSED_INPUT_SIZE);
+  std::ofstream(path, std::ios::binary) << compressed;
+
+  std::vector<Token> expected;
+  StringTokenizer str(content);
+  while(str.canRead()) expected.push_back(str.read());
+
+  for(bool threaded : {false, true})
+    for(std::size_t chunkSize : {1, 7, 64, 1 << 20}) {
+      lisp_reader::ZstdTokenizer tok{lisp_reader::ZstdReader(path.string(), threaded, chunkSize)};
+      checkTokenizerOutput(tok, expected);
+      REQUIRE(tok.offset() == content.size());
+    }
+
+  // Through an output buffer far smaller than a block, the decoder holds on to output between calls
+  // All of it comes out, even from a truncated stream before that is reported
+  auto produce = [&path](std::string &out) {
+		   lisp_reader::ZstdProducer producer(path.string());
+		   char buf[100];
+		   while(std::size_t n = producer.fill(buf, sizeof(buf))) out.append(buf, n);
+		 };
+  {
+    std::string out;
+    produce(out);
+    REQUIRE(out == content);
+  }
+  {
+    std::string truncated = compressed.substr(0, compressed.size() - 8), decoded(content.size(), '\0');
+    std::unique_ptr<ZSTD_DStream, std::size_t (*)(ZSTD_DStream *)> strm(ZSTD_createDStream(), &ZSTD_freeDStream);
+    ZSTD_inBuffer in{truncated.data(), truncated.size(), 0};
+    ZSTD_outBuffer whole{decoded.data(), decoded.size(), 0};
+    std::size_t ret = 0;
+    while(in.pos < in.size) ret = ZSTD_decompressStream(strm.get(), &whole, &in);
+    REQUIRE(ret != 0);
+    REQUIRE(whole.pos > half);
+
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << truncated;
+    std::string out;
+    REQUIRE_THROWS_WITH(produce(out), "Truncated zstd stream");
+    REQUIRE(out.size() == whole.pos);
+    REQUIRE(out == content.substr(0, whole.pos));
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << compressed;
+  }
+
+  // Errors from the decompressor surface on the reading thread
+  for(const std::string &bad : {compressed.substr(0, compressed.size() - 5), std::string("\x28\xb5\x2f\xfd not really zstd")}) {
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << bad;
+    for(bool threaded : {false, true}) {
+      lisp_reader::ZstdReader reader(path.string(), threaded);
+      REQUIRE_THROWS_AS([&reader] {char c; while(reader.read(c));}(), std::runtime_error);
+    }
+  }
+  std::filesystem::remove(path);
+
+  REQUIRE_THROWS_AS(lisp_reader::ZstdReader(path.string()), std::system_error);
+}
+#endif
+
 TEST_CASE("Can read more complex input", "[reader]") {
     checkStringTokenizerOutput("(\"Hello, World\")",
 			       {Token{TokenType::OPEN_PARENTHESIS, std::optional<TokenValue>()},
@@ -0,0 +1,267 @@
+#include "catch2/catch.hpp"
+
+#include "tree.hpp"
+#include "token_pipeline.hpp"
+#include "parallel_parser.hpp"
+#include "corpus.hpp"
+
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+using lisp_reader::StringTokenizer;
+using lisp_reader::TreeBuilder;
+using lisp_reader::Node;
+using lisp_reader::TokenType;
+
+// Helper methods
+// Builds every form in the input
+std::vector<const Node *> readForms(TreeBuilder &builder, std::string_view str) {
+  StringTokenizer tok(str);
+
+  return builder.read(tok);
+}
+
+
+TEST_CASE("Builds trees from tokens", "[tree]") {
+  TreeBuilder builder;
+  std::vector<const Node *> forms = readForms(builder, "(a (1 \"b\") ; comment\n ()) 2.5");
+
+  REQUIRE(forms.size() == 2);
+  const Node *list = forms[0];
+  REQUIRE(list->isList());
+  REQUIRE(list->children.size() == 3);
+  REQUIRE(list->children[0]->type() == TokenType::SYMBOL);
+  REQUIRE(list->children[0]->value.asString() == "a");
+  REQUIRE(list->children[1]->children.size() == 2);
+  REQUIRE(list->children[1]->children[0]->value.asInt() == 1);
+  REQUIRE(list->children[1]->children[1]->value.toToken() == lisp_reader::Token{TokenType::STRING, std::string("b")});
+  REQUIRE(list->children[2]->isList());
+  REQUIRE(list->children[2]->children.empty());
+  REQUIRE(forms[1]->type() == TokenType::FLOAT);
+
+  REQUIRE_THROWS_AS(readForms(builder, "(a))"), const char *);
+  REQUIRE_THROWS_AS(readForms(builder, "((a)"), const char *);
+}
+
+TEST_CASE("Shares structurally identical subtrees when hash-consing", "[tree]") {
+  std::string input;
+  for(int i = 0; i < 100; ++i)
+    input += "(field " + std::to_string(i) + " (type int) (nullable t))\n";
+
+  TreeBuilder plain;
+  TreeBuilder consed(true);
+  std::vector<const Node *> a = readForms(plain, input);
+  std::vector<const Node *> b = readForms(consed, input);
+
+  REQUIRE(a.size() == b.size());
+  for(std::size_t i = 0; i < a.size(); ++i) REQUIRE(lisp_reader::equal(a[i], b[i]));
+
+  // Only the field numbers differ between forms, everything else is built once
+  REQUIRE(b[0]->children[2] == b[99]->children[2]);
+  REQUIRE(b[0]->children[0] == b[99]->children[0]);
+  REQUIRE(b[0] != b[1]);
+  REQUIRE(a[0]->children[2] != a[99]->children[2]);
+  REQUIRE(consed.size() < plain.size() / 4);
+  REQUIRE(consed.size() + consed.shared() == plain.size());
+
+  // Identical forms are the very same node
+  std::vector<const Node *> again = readForms(consed, input);
+  REQUIRE(again == b);
+}
+
+TEST_CASE("Keeps values that only compare equal apart when hash-consing", "[tree]") {
+  TreeBuilder builder(true);
+  std::vector<const Node *> forms = readForms(builder, "(0.0 -0.0 1 1.0 a \"a\" 1/2 2/4)");
+
+  const lisp_reader::NodeList &c = forms[0]->children;
+  REQUIRE(c[0] != c[1]);
+  REQUIRE(!lisp_reader::equal(c[0], c[1]));
+  REQUIRE(c[2] != c[3]);
+  REQUIRE(c[4] != c[5]);
+  REQUIRE(c[6] == c[7]);
+}
+
+TEST_CASE("Bounds the number of distinct symbols", "[tree]") {
+  lisp_reader::ReaderLimits limits;
+  limits.maxSymbols = 2;
+  TreeBuilder builder(false, limits);
+
+  readForms(builder, "(a b (a b) b)");
+  REQUIRE(builder.arena().symbols() == 2);
+  try {
+    readForms(builder, "(a 1 \"c\" c)");
+    FAIL("No LimitError thrown");
+  }
+  catch(const lisp_reader::LimitError &e) {
+    REQUIRE(e.limit() == lisp_reader::Limit::SYMBOLS);
+    REQUIRE(e.token() == 4);
+  }
+}
+
+TEST_CASE("Allocates everything from the given memory resource", "[tree]") {
+  std::string input;
+  for(int i = 0; i < 100; ++i)
+    input += "(a-symbol-too-long-to-fit-inline-" + std::to_string(i) + " \"" + std::string(40, 's') + "\" ; comment\n 1/2 (x))\n";
+
+  std::pmr::monotonic_buffer_resource arena;
+  for(bool hashCons : {false, true}) {
+    // Anything still going to the default resource now throws
+    std::pmr::memory_resource *prev = std::pmr::set_default_resource(std::pmr::null_memory_resource());
+    std::vector<const Node *> forms;
+    REQUIRE_NOTHROW([&]() {
+		      TreeBuilder builder(hashCons, {}, &arena);
+		      StringTokenizer tok(lisp_reader::StringReader(input), {}, &arena);
+		      forms = builder.read(tok);
+		      REQUIRE(forms.size() == 100);
+		      REQUIRE(forms[99]->children[0]->value.asString() == "a-symbol-too-long-to-fit-inline-99");
+		    }());
+    std::pmr::set_default_resource(prev);
+  }
+}
+
+TEST_CASE("Builds the same trees through a token pipeline", "[tree]") {
+  std::string input;
+  lisp_reader::CorpusGenerator().generate(input, 256 << 10);
+  TreeBuilder serialBuilder;
+  std::vector<const Node *> serial = readForms(serialBuilder, input);
+
+  for(std::size_t batchSize : {1, 7, 512})
+    for(std::size_t depth : {1, 2, 8}) {
+      INFO(batchSize << " tokens per batch, " << depth << " batches");
+      TreeBuilder builder;
+      lisp_reader::TokenPipeline<lisp_reader::StringReader> pipeline(StringTokenizer(input), {batchSize, depth});
+      std::vector<const Node *> forms = builder.read(pipeline);
+
+      REQUIRE(forms.size() == serial.size());
+      for(std::size_t i = 0; i < forms.size(); ++i) REQUIRE(lisp_reader::equal(forms[i], serial[i]));
+      REQUIRE(!pipeline.canRead());
+    }
+
+  // Errors arrive after the tokens before them, with the index of the token that failed
+  for(std::size_t batchSize : {1, 3, 512}) {
+    lisp_reader::ReaderLimits limits;
+    limits.maxTokens = 5;
+    lisp_reader::TokenPipeline<lisp_reader::StringReader> pipeline(StringTokenizer(lisp_reader::StringReader("(a b c) d e"), limits),
+							       {batchSize, 2});
+    for(int i = 0; i < 5; ++i) {
+      REQUIRE(pipeline.canRead());
+      pipeline.read();
+    }
+    REQUIRE_THROWS_AS(pipeline.canRead(), lisp_reader::LimitError);
+    REQUIRE(pipeline.count() == 5);
+
+    lisp_reader::TokenPipeline<lisp_reader::StringReader> unclosed(StringTokenizer("(a \"b"), {batchSize, 2});
+    TreeBuilder builder;
+    REQUIRE_THROWS_WITH(builder.read(unclosed), "Missing closing double-quotes for string literal");
+  }
+
+  // Letting go early stops the lexer, even while it waits for room
+  {
+    lisp_reader::TokenPipeline<lisp_reader::StringReader> pipeline(StringTokenizer(input), {1, 1});
+    REQUIRE(pipeline.canRead());
+    pipeline.read();
+  }
+}
+
+TEST_CASE("Builds the same trees in parallel chunks", "[tree]") {
+  lisp_reader::CorpusOptions opts;
+  opts.maxDepth = 12;
+  opts.nestProbability = 0.6;
+  std::string input;
+  lisp_reader::CorpusGenerator(opts).generate(input, 128 << 10);
+  // One form spanning the whole input, so lists cross every chunk boundary
+  input = "(" + input + "\n)\n" + input;
+  TreeBuilder serialBuilder;
+  std::vector<const Node *> serial = readForms(serialBuilder, input);
+
+  for(std::size_t chunkSize : {0, 100, 4096, 1 << 20})
+    for(bool hashCons : {false, true}) {
+      INFO(chunkSize << " byte chunks");
+      lisp_reader::ParallelParserOptions popts;
+      popts.threads = 3;
+      popts.chunkSize = chunkSize;
+      popts.hashCons = hashCons;
+      lisp_reader::ParallelParser parser(popts);
+      std::vector<const Node *> forms = parser.parse(input);
+
+      if(chunkSize == 100) REQUIRE(parser.chunks() > 100);
+      REQUIRE(forms.size() == serial.size());
+      for(std::size_t i = 0; i < forms.size(); ++i) REQUIRE(lisp_reader::equal(forms[i], serial[i]));
+    }
+}
+
+TEST_CASE("Reports the first error when building in parallel chunks", "[tree]") {
+  std::string filler;
+  for(int i = 0; i < 50; ++i) filler += "(a (b c) \"d\") ";
+
+  // Every limit but maxSymbols, with maxTokens hit in the first chunk, in a later one, and past a later error
+  std::vector<lisp_reader::ReaderLimits> allLimits(5);
+  allLimits[0].maxDepth = 3;
+  allLimits[1].maxTokens = 7;
+  allLimits[2].maxTokens = 300;
+  allLimits[3].maxTokens = 900;
+  allLimits[3].maxDepth = 3;
+  allLimits[4].maxTokenLength = 8;
+  const std::vector<std::string> inputs{
+    filler + ")" + filler, "(" + filler, filler + "(" + filler + "))" + filler + "\"unclosed",
+    filler + "\"unclosed " + filler + ")", "((" + filler + "(x (y))" + filler + "))", filler + "a|b " + filler + ")",
+    "(" + filler + ")" + filler + ")", filler + filler + "(" + filler + ")" + filler,
+    filler + "long-symbol " + filler + filler
+  };
+
+  for(const lisp_reader::ReaderLimits &limits : allLimits)
+    for(const std::string &str : inputs)
+      for(std::size_t chunkSize : {16, 256, 0}) {
+	INFO(str << " in " << chunkSize << " byte chunks, with at most " << limits.maxTokens << " tokens");
+	std::string expected, error;
+	try {
+	  TreeBuilder builder(false, limits);
+	  StringTokenizer tok(lisp_reader::StringReader(str), limits);
+	  builder.read(tok);
+	}
+	catch(const char *e) {expected = e;}
+	catch(const std::exception &e) {expected = e.what();}
+
+	lisp_reader::ParallelParserOptions opts;
+	opts.threads = 2;
+	opts.chunkSize = chunkSize;
+	opts.limits = limits;
+	try {
+	  lisp_reader::ParallelParser(opts).parse(str);
+	}
+	catch(const char *e) {error = e;}
+	catch(const std::exception &e) {error = e.what();}
+
+	REQUIRE(error == expected);
+      }
+}
+
+TEST_CASE("Limits the tokens of the whole input when building in parallel chunks", "[tree]") {
+  std::string input;
+  for(int i = 0; i < 1000; ++i) input += "(a " + std::to_string(i) + ") ";
+
+  lisp_reader::ParallelParserOptions opts;
+  opts.threads = 3;
+  opts.chunkSize = 64;
+  opts.limits.maxTokens = 4000;
+  lisp_reader::ParallelParser parser(opts);
+  REQUIRE(parser.parse(input).size() == 1000);
+  REQUIRE(parser.chunks() > 50);
+
+  // One short, which only the last chunk runs into, after every other chunk read far fewer on its own
+  opts.limits.maxTokens = 3999;
+  try {
+    lisp_reader::ParallelParser(opts).parse(input);
+    FAIL("The token limit was not enforced");
+  }
+  catch(const lisp_reader::LimitError &e) {
+    REQUIRE(e.limit() == lisp_reader::Limit::TOKENS);
+    REQUIRE(e.token() == 3999);
+  }
+
+  opts.limits.maxSymbols = 10;
+  REQUIRE_THROWS_AS(lisp_reader::ParallelParser(opts), std::invalid_argument);
+  opts.chunkSize = 0;
+  REQUIRE_THROWS_AS(lisp_reader::ParallelParser(opts).parse(input), lisp_reader::LimitError);
+}
@@ -0,0 +1,79 @@
+#include "catch2/catch.hpp"
+
+#include "value.hpp"
+
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+using lisp_reader::StringTokenizer;
+using lisp_reader::Token;
+using lisp_reader::TokenType;
+using lisp_reader::Fraction;
+using lisp_reader::Value;
+using lisp_reader::ValueArena;
+
+
+TEST_CASE("Values convert back to the tokens they were built from", "[value]") {
+  ValueArena arena;
+  StringTokenizer tok("(sym 42 -7 1.5f 2.25 -0.0 3/4 -5/6 1000000000/3 \"a string\" ; comment\n)");
+
+  while(tok.canRead()) {
+    Token t = tok.read();
+    Value v = arena.value(t);
+    if(t.first == TokenType::CLOSE_PARENTHESIS) {
+      REQUIRE(v.isList());
+      continue;
+    }
+
+    REQUIRE(v.type() == t.first);
+    REQUIRE(v.toToken() == t);
+  }
+}
+
+TEST_CASE("Values pack everything but text into a single word", "[value]") {
+  REQUIRE(Value::fromInt(std::numeric_limits<int>::min()).asInt() == std::numeric_limits<int>::min());
+  REQUIRE(Value::fromInt(-1).type() == TokenType::INT);
+  REQUIRE(Value::fromFloat(-2.5f).asFloat() == -2.5f);
+  REQUIRE(Value::fromDouble(-std::numeric_limits<double>::infinity()).type() == TokenType::DOUBLE);
+  REQUIRE(Value::fromDouble(-std::numeric_limits<double>::infinity()).asDouble() == -std::numeric_limits<double>::infinity());
+
+  // Every NaN, whatever its payload or sign, folds into one that cannot be mistaken for a tagged value
+  Value nan = Value::fromDouble(-std::nan("123"));
+  REQUIRE(nan.type() == TokenType::DOUBLE);
+  REQUIRE(std::isnan(nan.asDouble()));
+  REQUIRE(nan == Value::fromDouble(std::numeric_limits<double>::quiet_NaN()));
+  REQUIRE(Value::fromDouble(0.0) != Value::fromDouble(-0.0));
+
+  ValueArena arena;
+  REQUIRE(arena.fraction(Fraction(-3, 8388607)).asFraction() == Fraction(-3, 8388607));
+  REQUIRE(arena.fraction(Fraction(-3, 8388607)).bits() == arena.fraction(Fraction(-3, 8388607)).bits());
+  REQUIRE(arena.fraction(Fraction(1, 8388609)).asFraction() == Fraction(1, 8388609));
+  REQUIRE(arena.fraction(Fraction(1, 8388609)) == arena.fraction(Fraction(1, 8388609)));
+}
+
+TEST_CASE("Symbols are interned, strings only on request", "[value]") {
+  ValueArena arena;
+  Value a = arena.symbol("abc");
+  REQUIRE(a.bits() == arena.symbol("abc").bits());
+  REQUIRE(a.bits() != arena.symbol("abd").bits());
+  REQUIRE(arena.symbols() == 2);
+
+  Token str{TokenType::STRING, std::string("abc")};
+  REQUIRE(arena.value(str).bits() != arena.value(str).bits());
+  REQUIRE(arena.value(str) == arena.value(str));
+  REQUIRE(arena.value(str) != a);
+
+  ValueArena interning({}, true);
+  REQUIRE(interning.value(str).bits() == interning.value(str).bits());
+
+  // Equal across arenas, by content
+  ValueArena other;
+  REQUIRE(other.symbol("abc") == a);
+  REQUIRE(other.symbol("abc").hash() == a.hash());
+
+  // Text longer than a block gets its own
+  std::string big(1 << 20, 'x');
+  REQUIRE(arena.symbol(big).asString() == big);
+}